@@ -17,14 +17,6 @@
 #include "ks0108.h"
 #include "glcd.h"
 
-//Some variables used in multiple features
-extern volatile uint8_t screenmutex;
-extern volatile uint8_t just_pressed, pressed;
-extern volatile uint8_t timeoutcounter;
-extern volatile uint8_t time_format;
-extern volatile uint8_t time_h, time_m, time_s;
-extern volatile uint8_t date_d, date_m, date_y;
-
 
 /*+++++++++++++++++++++++++++++++++++++++++++++++++++++
    Autodimming Backlight
@@ -38,25 +30,13 @@ extern volatile uint8_t date_d, date_m, date_y;
       .data: 
 +++++++++++++++++++++++++++++++++++++++++++++++++++++*/
 #ifdef AUTODIM
-//enums   
-#define AUTODIM_SET_DAY_BRIGHT 1
-#define AUTODIM_SET_DAY_H 2
-#define AUTODIM_SET_DAY_M 3
-#define AUTODIM_SET_NIGHT_BRIGHT 4
-#define AUTODIM_SET_NIGHT_H 5
-#define AUTODIM_SET_NIGHT_M 6
-#define AUTODIM_DAY_BRIGHT 7
-#define AUTODIM_DAY_TIME 8
-#define AUTODIM_NIGHT_BRIGHT 9
-#define AUTODIM_NIGHT_TIME 10
-
 //the time variables hold the time of day in minutes
 // so 22:15 would be 22*60+15 = 1335
 volatile uint16_t autodim_day_time = 360;
 volatile uint16_t autodim_night_time = 1380;
 
-volatile uint8_t autodim_day_bright = 11;
-volatile uint8_t autodim_night_bright = 1;
+volatile uint8_t autodim_day_bright = 176;
+volatile uint8_t autodim_night_bright = 16;
 
 void autoDim(uint8_t hour, uint8_t minute)
 {
@@ -73,8 +53,8 @@ void autoDim(uint8_t hour, uint8_t minute)
       dayTimeStandard = temp;
    }
    
-   //find current time
-   uint16_t curTimeStandard = (hour*60)+minute;
+   //find current time (hour and minute come in BCD)
+   uint16_t curTimeStandard = (bcd2i(hour)*60)+bcd2i(minute);
    //standardize it
    temp = curTimeStandard - autodim_night_time;
    if(temp < 0)
@@ -99,369 +79,165 @@ void autoDim(uint8_t hour, uint8_t minute)
    }
 }
 
-void setBacklightAutoDim()
+//autoDim() for the time it is now
+void autoDimNow(void)
 {
-   uint8_t mode = AUTODIM_NIGHT_TIME;
-   uint8_t hour;
-   uint8_t minute;
-   screenmutex++; //exclude all other writes to the screen
-   glcdClearScreen();
-   
-   //title
-   glcdSetAddress(28, 0);
-   glcdPutStr("AutoDim Menu", NORMAL);
-   //bottom instructions
-   glcdSetAddress(0, 7);
-   glcdPutStr("Press Menu to Advance", NORMAL);
-   glcdSetAddress(0, 6);
-   glcdPutStr("Press Set to set ", NORMAL);
-   
-   //time 1
-   glcdSetAddress(MENU_INDENT, 1);
-   glcdPutStr("Set Time 1:", NORMAL);
-   glcdSetAddress(GLCD_XPIXELS - 36, 1);
-   hour = autodim_night_time/60;
-   minute = autodim_night_time%60;
-   print_timehour(hour, NORMAL);
-   glcdWriteChar(':', NORMAL);
-   printnumber(minute, NORMAL);
-   
-   if(time_format == TIME_12H)
-   {
-      if(hour > 12)
-      {
-         glcdWriteChar('P', NORMAL);
-      }
-      else
-      {
-         glcdWriteChar('A', NORMAL);
-      }
-   }  
-   
-   //brightness 1
-   glcdSetAddress(MENU_INDENT, 2);
-   glcdPutStr("Set Brightness: ", NORMAL);
-   glcdSetAddress(GLCD_XPIXELS-12, 2);
-   printnumber(autodim_night_bright>>OCR2B_BITSHIFT, NORMAL);
-   
-   //time 2
-   glcdSetAddress(MENU_INDENT, 4);
-   glcdPutStr("Set Time 2: ", NORMAL);
-   glcdSetAddress(GLCD_XPIXELS - 36, 4);
-   hour = autodim_day_time/60;
-   minute = autodim_day_time%60;
-   print_timehour(hour, NORMAL);
-   glcdWriteChar(':', NORMAL);
-   printnumber(minute, NORMAL);
-   
-   if(time_format == TIME_12H)
+   datetime_t now;
+   get_time_snapshot(&now);
+   autoDim(now.h, now.m);
+}
+
+//The AutoDim menu, menu.c runs it from the configuration menu
+
+//a time while it is being set, in BCD
+static uint8_t autodim_h, autodim_m;
+
+//a time (field 0), or what it is being set to
+static void draw_autodim_time(uint16_t t, uint8_t field)
+{
+   uint8_t hour = i2bcd(t/60);
+   uint8_t minute = i2bcd(t%60);
+
+   if(field)
    {
-      if(hour > 12)
-      {
-         glcdWriteChar('P', NORMAL);
-      }
-      else
-      {
-         glcdWriteChar('A', NORMAL);
-      }
+      hour = autodim_h;
+      minute = autodim_m;
    }
-   
-   //brightness 2
-   glcdSetAddress(MENU_INDENT,5);
-   glcdPutStr("Set Brightness: ", NORMAL);
-   glcdSetAddress(GLCD_XPIXELS - 12, 5);
-   printnumber(autodim_day_bright>>OCR2B_BITSHIFT, NORMAL);
-   
-   drawArrow(0, 11, MENU_INDENT -1);
-   
-   uint8_t exit = 0;
-   while(!exit)
-   {
-      
-      if(just_pressed & 0x1)
-      {
-         just_pressed = 0;
-         switch(mode)
-         {
-            case AUTODIM_NIGHT_TIME:
-               mode = AUTODIM_NIGHT_BRIGHT;
-               glcdFillRectangle(0, 0, MENU_INDENT -1, 48, NORMAL);
-               drawArrow(0, 19, MENU_INDENT -1);
-               break;
-            
-            case AUTODIM_NIGHT_BRIGHT:
-               mode = AUTODIM_DAY_TIME;
-               glcdFillRectangle(0, 0, MENU_INDENT -1, 48, NORMAL);
-               drawArrow(0, 35, MENU_INDENT -1);
-               break;
-            
-            case AUTODIM_DAY_TIME:
-               mode = AUTODIM_DAY_BRIGHT;
-               glcdFillRectangle(0, 0, MENU_INDENT -1, 48, NORMAL);
-               drawArrow(0, 43, MENU_INDENT - 1);
-               glcdSetAddress(0, 7);
-               glcdPutStr("Press Menu to Exit    ", NORMAL);
-               break;
-               
-            case AUTODIM_SET_NIGHT_H:
-            case AUTODIM_SET_NIGHT_M:
-            case AUTODIM_SET_DAY_H:
-            case AUTODIM_SET_DAY_M:
-            case AUTODIM_SET_NIGHT_BRIGHT:
-            case AUTODIM_SET_DAY_BRIGHT:
-               break;
-               
-            default:
-               exit = 1;
-               break;
-         }
-      }
-      if(just_pressed || pressed)
-      {
-         timeoutcounter = INACTIVITYTIMEOUT;
-      }
-      /*else if(!timeoutcounter)
-      {
-         exit = 1;
-         continue;
-      }*/
-      
-      if(just_pressed & 0x2)
-      {
-         just_pressed = 0;
-         switch(mode)
-         {
-            //Nighttime Brightness
-            case AUTODIM_NIGHT_BRIGHT:
-               mode = AUTODIM_SET_NIGHT_BRIGHT;
-               OCR2B = autodim_night_bright;
-               glcdSetAddress(GLCD_XPIXELS -12, 2);
-               printnumber(autodim_night_bright>>OCR2B_BITSHIFT, INVERTED);
-               glcdSetAddress(0, 6);
-               glcdPutStr("Press + to change", NORMAL);
-               break;
-            case AUTODIM_SET_NIGHT_BRIGHT:
-               mode = AUTODIM_NIGHT_BRIGHT;
-               glcdSetAddress(GLCD_XPIXELS -12, 2);
-               printnumber(OCR2B>>OCR2B_BITSHIFT, NORMAL);
-               autodim_night_bright = OCR2B;
-               #ifdef AUTODIM_EEPROM
-               if(autodim_night_bright != eeprom_read_byte((uint8_t *)EE_AUTODIM_NIGHT_BRIGHT))
-                  eeprom_write_byte((uint8_t *)EE_AUTODIM_NIGHT_BRIGHT, autodim_night_bright);
-               #endif
-               autoDim(time_h, time_m);
-               glcdSetAddress(0, 6);
-               glcdPutStr("Press Set to set ", NORMAL);
-               break;            
-               
-            //Daytime Brightness
-            case AUTODIM_DAY_BRIGHT:
-               mode = AUTODIM_SET_DAY_BRIGHT;
-               OCR2B = autodim_day_bright;
-               glcdSetAddress(GLCD_XPIXELS -12, 5);
-               printnumber(autodim_day_bright>>OCR2B_BITSHIFT, INVERTED);
-               glcdSetAddress(0, 6);
-               glcdPutStr("Press + to change", NORMAL);
-               break;
-            case AUTODIM_SET_DAY_BRIGHT:
-               mode = AUTODIM_DAY_BRIGHT;
-               glcdSetAddress(GLCD_XPIXELS -12, 5);
-               printnumber(OCR2B>>OCR2B_BITSHIFT, NORMAL);
-               autodim_day_bright = OCR2B;
-               #ifdef AUTODIM_EEPROM
-               if(autodim_day_bright != eeprom_read_byte((uint8_t *)EE_AUTODIM_DAY_BRIGHT))
-                  eeprom_write_byte((uint8_t *)EE_AUTODIM_DAY_BRIGHT, autodim_day_bright);
-               #endif
-               autoDim(time_h, time_m);
-               glcdSetAddress(0, 6);
-               glcdPutStr("Press Set to set ", NORMAL);
-               break;
-            
-
-            //Day time
-            case AUTODIM_DAY_TIME:
-               mode = AUTODIM_SET_DAY_H;
-               glcdSetAddress(GLCD_XPIXELS - 36, 4);
-               print_timehour(autodim_day_time/60, INVERTED);
-               autoDim(time_h, time_m);
-               glcdSetAddress(0, 6);
-               glcdPutStr("Press + to change", NORMAL);
-               break;
-            case AUTODIM_SET_DAY_H:
-               mode = AUTODIM_SET_DAY_M;
-               glcdSetAddress(GLCD_XPIXELS - 36, 4);
-               print_timehour(autodim_day_time/60, NORMAL);
-               glcdSetAddress(GLCD_XPIXELS - 18, 4);
-               printnumber(autodim_day_time%60, INVERTED);
-               break;
-            case AUTODIM_SET_DAY_M:
-               mode = AUTODIM_DAY_TIME;
-               glcdSetAddress(GLCD_XPIXELS - 18, 4);
-               printnumber(autodim_day_time%60, NORMAL);
-               glcdSetAddress(0, 6);
-               glcdPutStr("Press Set to set ", NORMAL);
-               #ifdef AUTODIM_EEPROM
-               if(autodim_day_time != eeprom_read_word((uint16_t *)EE_AUTODIM_DAY_TIME))
-                  eeprom_write_word((uint16_t *)EE_AUTODIM_DAY_TIME, autodim_day_time);
-               #endif
-               break;
-
-            //Night Time
-            case AUTODIM_NIGHT_TIME:
-               mode = AUTODIM_SET_NIGHT_H;
-               glcdSetAddress(GLCD_XPIXELS - 36, 1);
-               print_timehour(autodim_night_time/60, INVERTED);
-               autoDim(time_h, time_m);
-               glcdSetAddress(0, 6);
-               glcdPutStr("Press + to change", NORMAL);
-               break;
-            case AUTODIM_SET_NIGHT_H:
-               mode = AUTODIM_SET_NIGHT_M;
-               glcdSetAddress(GLCD_XPIXELS - 36, 1);
-               print_timehour(autodim_night_time/60, NORMAL);
-               glcdSetAddress(GLCD_XPIXELS - 18, 1);
-               printnumber(autodim_night_time%60, INVERTED);
-               break;
-            case AUTODIM_SET_NIGHT_M:
-               mode = AUTODIM_NIGHT_TIME;
-               glcdSetAddress(GLCD_XPIXELS - 18, 1);
-               printnumber(autodim_night_time%60, NORMAL);
-               glcdSetAddress(0, 6);
-               glcdPutStr("Press Set to set ", NORMAL);
-               #ifdef AUTODIM_EEPROM
-               if(autodim_night_time != eeprom_read_word((uint16_t *)EE_AUTODIM_NIGHT_TIME))
-                  eeprom_write_word((uint16_t *)EE_AUTODIM_NIGHT_TIME, autodim_night_time);
-               #endif
-               break;
-            
-            default:
-               break;
-         }
-         
-      }
-      
-      if((just_pressed & 0x4) || (pressed & 0x4))
-      {
-         just_pressed = 0;
-         
-         //night brightness
-         if(mode == AUTODIM_SET_NIGHT_BRIGHT)
-         {
-            OCR2B += OCR2B_PLUS;
-            if(OCR2B > OCR2A_VALUE)
-            {
-               OCR2B = 0;
-            }
-            
-            glcdSetAddress(GLCD_XPIXELS - 12, 2);
-            printnumber(OCR2B>>OCR2B_BITSHIFT, INVERTED);
-         }  
-
-         //day brightness
-         if(mode == AUTODIM_SET_DAY_BRIGHT)
-         {
-            OCR2B += OCR2B_PLUS;
-            if(OCR2B > OCR2A_VALUE)
-            {
-               OCR2B = 0;
-            }
-            
-            glcdSetAddress(GLCD_XPIXELS - 12, 5);
-            printnumber(OCR2B>>OCR2B_BITSHIFT, INVERTED);
-         }
-         
-         //day hour
-         if(mode == AUTODIM_SET_DAY_H)
-         {
-            autodim_day_time += 60; //add an hour
-            if(autodim_day_time/60 >= 24)
-            {
-               autodim_day_time = 0 + autodim_day_time%60;
-            }
-               
-            glcdSetAddress(GLCD_XPIXELS-36, 4);
-            print_timehour(autodim_day_time/60, INVERTED);
-            
-            if(time_format == TIME_12H)
-            {
-               glcdSetAddress(GLCD_XPIXELS -6, 4);
-               if((autodim_day_time/60) >= 12)
-               {
-                  glcdWriteChar('P', NORMAL);
-               }
-               else
-               {
-                  glcdWriteChar('A', NORMAL);
-               }
-            }
-            if(pressed)
-               _delay_ms(200);
-         }
+   print_timehour(hour, field == 1);
+   glcdWriteChar(':', NORMAL);
+   printbcd(minute, field == 2);
+   print_ampm(hour, field == 1);
+}
 
-         //night hour
-         if(mode == AUTODIM_SET_NIGHT_H)
-         {
-            autodim_night_time += 60; //add an hour
-            if(autodim_night_time/60 >= 24)
-            {
-               autodim_night_time = 0 + autodim_night_time%60;
-            }
-            
-            glcdSetAddress(GLCD_XPIXELS-36, 1);
-            print_timehour(autodim_night_time/60, INVERTED);
-            
-            if(time_format == TIME_12H)
-            {
-               glcdSetAddress(GLCD_XPIXELS -6, 1);
-               if(autodim_night_time/60 >= 12)
-               {
-                  glcdWriteChar('P', NORMAL);
-               }
-               else
-               {
-                  glcdWriteChar('A', NORMAL);
-               }
-            }
-            if(pressed)
-               _delay_ms(200);
-         }
-         
-         //day minute
-         if(mode == AUTODIM_SET_DAY_M)
-         {
-            if(((autodim_day_time%60)+1) > 60)
-            {
-               autodim_day_time = autodim_day_time/60;
-            }
-            autodim_day_time++;
-            
-            glcdSetAddress(GLCD_XPIXELS-18, 4);
-            printnumber(autodim_day_time%60, INVERTED);
-            if(pressed)
-               _delay_ms(200);
-         }     
-         
-         //night minute
-         if(mode == AUTODIM_SET_NIGHT_M)
-         {
-            if(((autodim_night_time%60)+1) > 60)
-            {
-               autodim_night_time = autodim_night_time/60;
-            }
-            autodim_night_time++;
-            
-            glcdSetAddress(GLCD_XPIXELS-18, 1);
-            printnumber(autodim_night_time%60, INVERTED);
-            if(pressed)
-               _delay_ms(200);
-         }
-      }
-   }
-   
-   screenmutex--; //return the screen
-   return;
+static void load_autodim_time(uint16_t t)
+{
+   autodim_h = i2bcd(t/60);
+   autodim_m = i2bcd(t%60);
+}
+
+static void save_autodim_time(volatile uint16_t *t, uint8_t ee)
+{
+   *t = bcd2i(autodim_h)*60 + bcd2i(autodim_m);
+   #ifdef AUTODIM_EEPROM
+   if(*t != eeprom_read_word((uint16_t *)(uint16_t)ee))
+      eeprom_write_word((uint16_t *)(uint16_t)ee, *t);
+   #endif
+   autoDimNow();
+}
+
+//the brightness is set on OCR2B, so it can be seen
+static void draw_autodim_bright(uint8_t bright, uint8_t field)
+{
+   printnumber3(field ? OCR2B : bright, field);
+}
+
+static void save_autodim_bright(volatile uint8_t *bright, uint8_t ee)
+{
+   *bright = OCR2B;
+   #ifdef AUTODIM_EEPROM
+   menu_ee_update(ee, *bright);
+   #endif
+   autoDimNow();
 }
 
+#ifdef AUTODIM_EEPROM
+#define AUTODIM_EE(x) (x)
+#else
+#define AUTODIM_EE(x) 0
+#endif
+
+//Time 1, when it dims
+static void draw_night_time(uint8_t field)
+{
+   draw_autodim_time(autodim_night_time, field);
+}
+
+static void load_night_time(void)
+{
+   load_autodim_time(autodim_night_time);
+}
+
+static void save_night_time(void)
+{
+   save_autodim_time(&autodim_night_time, AUTODIM_EE(EE_AUTODIM_NIGHT_TIME));
+}
+
+static void draw_night_bright(uint8_t field)
+{
+   draw_autodim_bright(autodim_night_bright, field);
+}
+
+static void load_night_bright(void)
+{
+   OCR2B = autodim_night_bright;
+}
+
+static void save_night_bright(void)
+{
+   save_autodim_bright(&autodim_night_bright, AUTODIM_EE(EE_AUTODIM_NIGHT_BRIGHT));
+}
+
+//Time 2, when it brightens
+static void draw_day_time(uint8_t field)
+{
+   draw_autodim_time(autodim_day_time, field);
+}
+
+static void load_day_time(void)
+{
+   load_autodim_time(autodim_day_time);
+}
+
+static void save_day_time(void)
+{
+   save_autodim_time(&autodim_day_time, AUTODIM_EE(EE_AUTODIM_DAY_TIME));
+}
+
+static void draw_day_bright(uint8_t field)
+{
+   draw_autodim_bright(autodim_day_bright, field);
+}
+
+static void load_day_bright(void)
+{
+   OCR2B = autodim_day_bright;
+}
+
+static void save_day_bright(void)
+{
+   save_autodim_bright(&autodim_day_bright, AUTODIM_EE(EE_AUTODIM_DAY_BRIGHT));
+}
+
+static const menu_field_t autodim_time_fields[] PROGMEM = {
+   { &autodim_h, 0, 0x23, 1, MENU_BCD, MENU_NO_EE },
+   { &autodim_m, 0, 0x59, 1, MENU_BCD, MENU_NO_EE },
+};
+
+static const menu_field_t autodim_bright_fields[] PROGMEM = {
+   { &OCR2B, 0, BRIGHT_MAX, BRIGHT_STEP, 0, MENU_NO_EE },
+};
+
+static const char autodim_title[] PROGMEM = "AutoDim Menu";
+static const char autodim_time1_label[] PROGMEM = "Set Time 1:";
+static const char autodim_time2_label[] PROGMEM = "Set Time 2:";
+static const char autodim_bright_label[] PROGMEM = "Set Brightness:";
+
+static const menu_item_t autodim_items[] PROGMEM = {
+   { autodim_time1_label, 1, GLCD_XPIXELS - 42, SET_BRIGHTNESS, 0,
+     2, autodim_time_fields, draw_night_time, 0, load_night_time, 0, save_night_time, 0 },
+   { autodim_bright_label, 2, GLCD_XPIXELS - 18, SET_BRIGHTNESS, 0,
+     1, autodim_bright_fields, draw_night_bright, 0, load_night_bright, 0, save_night_bright, 0 },
+   { autodim_time2_label, 4, GLCD_XPIXELS - 42, SET_BRIGHTNESS, 0,
+     2, autodim_time_fields, draw_day_time, 0, load_day_time, 0, save_day_time, 0 },
+   { autodim_bright_label, 5, GLCD_XPIXELS - 18, SET_BRIGHTNESS, 0,
+     1, autodim_bright_fields, draw_day_bright, 0, load_day_bright, 0, save_day_bright, 0 },
+};
+
+//run from the configuration menu's "Set AutoDim"
+const menu_t autodim_menu PROGMEM = {
+   autodim_title, sizeof(autodim_items) / sizeof(autodim_items[0]), autodim_items
+};
+
 #ifdef AUTODIM_EEPROM
 void init_autodim_eeprom()
 {
@@ -472,7 +248,7 @@ void init_autodim_eeprom()
    day_bright = eeprom_read_byte((uint8_t *)EE_AUTODIM_DAY_BRIGHT);
    night_bright = eeprom_read_byte((uint8_t *)EE_AUTODIM_NIGHT_BRIGHT);
    
-   if((day_time >= 0) && (day_time <= 1440))
+   if(day_time <= 1440)
    {
       autodim_day_time = day_time;
    }
@@ -481,7 +257,7 @@ void init_autodim_eeprom()
        eeprom_write_word((uint16_t *)EE_AUTODIM_DAY_TIME, autodim_day_time);
    }
    
-   if((night_time >= 0) && (night_time <= 1440))
+   if(night_time <= 1440)
    {
       autodim_night_time = night_time;
    }
@@ -490,23 +266,10 @@ void init_autodim_eeprom()
       eeprom_write_word((uint16_t *)EE_AUTODIM_NIGHT_TIME, autodim_night_time);
    }
       
-   if((day_bright >= 0) && (day_bright <= OCR2A_VALUE))
-   {
-      autodim_day_bright = day_bright;
-   }
-   else
-   {
-      eeprom_write_byte((uint8_t *)EE_AUTODIM_DAY_BRIGHT, autodim_day_bright);
-   }
-      
-   if((night_bright >= 0) && (night_bright <= OCR2A_VALUE))
-   {
-      autodim_night_bright = night_bright;
-   }
-   else
-   {
-      eeprom_write_byte((uint8_t *)EE_AUTODIM_NIGHT_BRIGHT, autodim_night_bright);
-   }
+   //every byte is a brightness, init_eeprom() has already put
+   //any from older firmware on the 0-BRIGHT_MAX scale
+   autodim_day_bright = day_bright;
+   autodim_night_bright = night_bright;
 }
 #endif //#ifdef AUTODIM_EEPROM
 #endif //#ifdef AUTODIM
@@ -589,26 +352,30 @@ uint32_t dstCalculate(uint8_t hour, uint8_t dotw_target, uint8_t n, uint8_t mont
 
 void autodst(uint8_t* rule)
 {
+   datetime_t now;
+   get_time_snapshot(&now);
+
    //reset autodst_changedToday
-   if((time_h == 00)&&(time_m == 00))
+   if((now.h == 00)&&(now.m == 00))
       autodst_changedToday = 0;
 
       
    //calculate where in the year the dst days are
-   uint32_t startSeconds = dstCalculate(rule[0], rule[1], rule[2], rule[3], date_y);
-   uint32_t endSeconds = dstCalculate(rule[4], rule[5], rule[6], rule[7], date_y);
+   uint8_t year = bcd2i(now.y);
+   uint32_t startSeconds = dstCalculate(rule[0], rule[1], rule[2], rule[3], year);
+   uint32_t endSeconds = dstCalculate(rule[4], rule[5], rule[6], rule[7], year);
    
-   //calculate how far into the year we are.
-   uint32_t nowSeconds = secondsIntoYear(date_d, date_m, date_y);
-   nowSeconds = nowSeconds + time_h*3600 + time_m*60 + time_s;
+   //calculate how far into the year we are (the time and date are BCD).
+   uint32_t nowSeconds = secondsIntoYear(bcd2i(now.d), bcd2i(now.mo), year);
+   nowSeconds = nowSeconds + bcd2i(now.h)*3600UL + bcd2i(now.m)*60 + bcd2i(now.s);
    
    if(((nowSeconds < startSeconds)||(nowSeconds >= endSeconds))&& autodst_isDST && !autodst_changedToday)
    {
       autodst_isDST = 0;
       update_autodst_eeprom(0);
       autodst_changedToday = 1;
-      uint8_t hour = time_h - 1;
-      writei2ctime(time_s, time_m, hour, 0, date_d, date_m, date_y);
+      now.h = bcd_dec(now.h);
+      rtc_set(&now);
    }
    
    if(((nowSeconds >= startSeconds) && (nowSeconds < endSeconds)) && !autodst_isDST && !autodst_changedToday)
@@ -616,8 +383,8 @@ void autodst(uint8_t* rule)
       autodst_isDST = 1;
       update_autodst_eeprom(1);
       autodst_changedToday = 1;
-      uint8_t hour = time_h + 1;
-      writei2ctime(time_s, time_m, hour, 0, date_d, date_m, date_y);
+      now.h = bcd_inc(now.h);
+      rtc_set(&now);
    }   
    glcdSetAddress(0,0);
    printnumber( autodst_isDST, 1);
@@ -21,29 +21,40 @@
 #include "glcd.h"
 #include "font5x7.h"
 
-extern volatile uint8_t time_s, time_m, time_h;
-extern volatile uint8_t old_m, old_h;
-extern volatile uint8_t date_m, date_d, date_y;
 extern volatile uint8_t alarming, alarm_h, alarm_m;
 extern volatile uint8_t time_format;
 extern volatile uint8_t region;
 extern volatile uint8_t score_mode;
 extern volatile uint8_t baseInverted;
+extern volatile uint8_t rtc_lost;
 #ifdef AUTODST
 extern volatile uint8_t autodst_isDST;
 #endif
 
 //A couple variables to print some basic message on the screen as a place holder for a new animation.
+//It walks down the text lines under the big time, from MSG_FIRST_LINE.
+#define MSG_FIRST_LINE ((DISPLAY_TIME_Y + 8*DISPLAY_DIGITSCALE + 7) / 8)
 uint8_t xpos, ypos;
 char msg[22];
 
 extern volatile uint8_t minute_changed, hour_changed;
 
+// the time the display shows: step() moves it on to the clock's time
+// when it sees the minute change
+datetime_t shown_time;
+
 //Is it time to redraw the screen?
 uint8_t redraw_time = 0;
 
 uint8_t last_score_mode = 0;
 
+// big digits currently on the display, 0xFF if it has to be drawn
+uint8_t bigdigit_shown[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+// and whether the colon between them is
+uint8_t bigcolon_shown = 0;
+// whether "NO RTC" is on the display
+uint8_t rtc_lost_shown = 0;
+
 uint32_t rval[2]={0,0};
 uint32_t key[4];
 
@@ -60,6 +71,9 @@ void encipher(void) {  // Using 32 rounds of XTea encryption as a PRNG.
 
 void init_crand(void) {
   uint32_t temp;
+  datetime_t now;
+
+  get_time_snapshot(&now);
   key[0]=0x2DE9716E;  //Initial XTEA key. Grabbed from the first 16 bytes
   key[1]=0x993FDDD1;  //of grc.com/password.  1 in 2^128 chance of seeing
   key[2]=0x2A77FB57;  //that key again there.
@@ -69,11 +83,11 @@ void init_crand(void) {
   encipher();
   temp = alarm_h;
   temp<<=8;
-  temp|=time_h;
+  temp|=now.h;
   temp<<=8;
-  temp|=time_m;
+  temp|=now.m;
   temp<<=8;
-  temp|=time_s;
+  temp|=now.s;
   key[0]^=rval[1]<<1;
   encipher();
   key[1]^=temp<<1;
@@ -84,11 +98,11 @@ void init_crand(void) {
   encipher();
   temp = alarm_m;
   temp<<=8;
-  temp|=date_m;
+  temp|=now.mo;
   temp<<=8;
-  temp|=date_d;
+  temp|=now.d;
   temp<<=8;
-  temp|=date_y;
+  temp|=now.y;
   key[0]^=temp<<1;
   encipher();
   key[1]^=rval[0]<<1;
@@ -148,15 +162,14 @@ void initanim(void) {
   DEBUG(uart_putw_dec(GLCD_YPIXELS));
   DEBUG(putstring_nl(""));
   xpos = 0;
-  ypos = 0;
+  ypos = MSG_FIRST_LINE;
   
    minute_changed = 0;
    hour_changed = 0;
-   if(ypos >= GLCD_TEXT_LINES)
-      ypos = 0;
-      strcpy(msg, "Hello World");
+   get_time_snapshot(&shown_time);
+   strcpy(msg, "Hello World");
    
-   if(time_m & 0x1)
+   if(shown_time.m & 0x1)
    {
       baseInverted = 1;
    }
@@ -172,6 +185,12 @@ void initdisplay(uint8_t inverted) {
    glcdFillRectangle(0,0,GLCD_XPIXELS, GLCD_YPIXELS, inverted);
    glcdSetAddress(xpos, ypos);
    glcdPutStr(msg, inverted);
+   // the screen was wiped, all digits have to go back on
+   memset(bigdigit_shown, 0xFF, sizeof(bigdigit_shown));
+   bigcolon_shown = 0;
+   rtc_lost_shown = 0;
+   drawbigtime(inverted);
+   drawrtcstatus(inverted);
 }
 
 //advance the animation by one step. This function is called from ratt.c every ANIM_TICK miliseconds.
@@ -182,12 +201,12 @@ void step(void) {
       redraw_time = 1;
       minute_changed = 0;
       hour_changed = 0;
+      get_time_snapshot(&shown_time);
       ypos++;
       if(ypos >= GLCD_TEXT_LINES)
-         ypos = 0;
-         strcpy(msg, "Hello World");
+         ypos = MSG_FIRST_LINE;
       
-      if(time_m & 0x1)
+      if(shown_time.m & 0x1)
       {
          baseInverted = 1;
       }
@@ -196,6 +215,9 @@ void step(void) {
          baseInverted = 0;
       }
    }
+   // only bother draw() when there is something new to show
+   if(redraw_time)
+      sched_ready(TASK_DRAW);
 }
 
 //draw everything to the screen
@@ -208,7 +230,26 @@ void draw(uint8_t inverted) {
       glcdFillRectangle(0,0,GLCD_XPIXELS, GLCD_YPIXELS, inverted);
       glcdSetAddress(xpos, ypos);
       //glcdPutStr(msg, inverted);
+      memset(bigdigit_shown, 0xFF, sizeof(bigdigit_shown));
+      bigcolon_shown = 0;
+      rtc_lost_shown = 0;
    }
+   drawbigtime(inverted);
+   drawrtcstatus(inverted);
+}
+
+// bottom right, while the RTC doesn't answer and timer0 keeps the time
+void drawrtcstatus(uint8_t inverted) {
+   if(rtc_lost == rtc_lost_shown)
+      return;
+   rtc_lost_shown = rtc_lost;
+   if(rtc_lost)
+   {
+      glcdSetAddress(GLCD_XPIXELS - 6*6, GLCD_TEXT_LINES-1);
+      glcdPutStr("NO RTC", !inverted);
+   }
+   else
+      glcdFillRectangle(GLCD_XPIXELS - 6*6, GLCD_YPIXELS - 8, 6*6, 8, inverted);
 }
 
 // 8 pixels high
@@ -226,6 +267,83 @@ static unsigned char __attribute__ ((progmem)) BigFont[] = {
 	0x00, 0x00, 0x00, 0x00,// SPACE
 };
 
+// where each BigFont row (top first) lands when blown up 2x to 6x:
+// page of the digit, then the fat pixel's bits in that page and the next
+static unsigned char __attribute__ ((progmem)) BigExpand[5][8][3] = {
+	{ {0,0x03,0x00}, {0,0x0C,0x00}, {0,0x30,0x00}, {0,0xC0,0x00}, {1,0x03,0x00}, {1,0x0C,0x00}, {1,0x30,0x00}, {1,0xC0,0x00} },// x2
+	{ {0,0x07,0x00}, {0,0x38,0x00}, {0,0xC0,0x01}, {1,0x0E,0x00}, {1,0x70,0x00}, {1,0x80,0x03}, {2,0x1C,0x00}, {2,0xE0,0x00} },// x3
+	{ {0,0x0F,0x00}, {0,0xF0,0x00}, {1,0x0F,0x00}, {1,0xF0,0x00}, {2,0x0F,0x00}, {2,0xF0,0x00}, {3,0x0F,0x00}, {3,0xF0,0x00} },// x4
+	{ {0,0x1F,0x00}, {0,0xE0,0x03}, {1,0x7C,0x00}, {1,0x80,0x0F}, {2,0xF0,0x01}, {3,0x3E,0x00}, {3,0xC0,0x07}, {4,0xF8,0x00} },// x5
+	{ {0,0x3F,0x00}, {0,0xC0,0x0F}, {1,0xF0,0x03}, {2,0xFC,0x00}, {3,0x3F,0x00}, {3,0xC0,0x0F}, {4,0xF0,0x03}, {5,0xFC,0x00} },// x6
+};
+
+// draw BigFont digit d (10 is a blank) blown up by scale with its top left corner at x, y
+void drawbigdigit(uint8_t x, uint8_t y, uint8_t d, uint8_t scale, uint8_t inverted) {
+  uint8_t line[4*6];	// one page of the digit, 4 fat columns of up to 6
+  uint8_t page, c, i, src, at, b;
+  const unsigned char *expand;
+
+  if ((scale < 2) || (scale > 6) || (d > 10))
+    return;
+  expand = &BigExpand[scale-2][0][0];
+
+  for (page = 0; page < scale; page++) {
+    for (c = 0; c < 4; c++) {
+      // the font rows of this column that land in this page
+      src = pgm_read_byte(&BigFont[d*4 + c]);
+      b = 0;
+      for (i = 0; i < 8; i++, src <<= 1) {
+	if (! (src & 0x80))
+	  continue;
+	at = pgm_read_byte(expand + i*3);
+	if (at == page)
+	  b |= pgm_read_byte(expand + i*3 + 1);
+	else if (at + 1 == page)
+	  b |= pgm_read_byte(expand + i*3 + 2);
+      }
+      if (inverted)
+	b = ~b;
+      // and repeat it to make the column fat
+      memset(line + c*scale, b, scale);
+    }
+    glcdBlitRam(x, y + page*8, 4*scale, 8, line, GLCD_BLIT_COPY);
+  }
+}
+
+// draw the time in big digits, only the digits that changed since last time
+void drawbigtime(uint8_t inverted) {
+  uint8_t d[4], i, h;
+  static const uint8_t xs[4] = {DISPLAY_H10_X, DISPLAY_H1_X, DISPLAY_M10_X, DISPLAY_M1_X};
+
+  h = shown_time.h;
+  if (time_format == TIME_12H)
+    h = bcd_hour12(h);
+  d[0] = h >> 4;
+  d[1] = h & 0xF;
+  d[2] = shown_time.m >> 4;
+  d[3] = shown_time.m & 0xF;
+  // no leading zero on the hours in 12 hour mode
+  if ((time_format == TIME_12H) && (d[0] == 0))
+    d[0] = 10;
+
+  // the colon only has to go back on after the screen was wiped, two
+  // fat pixels level with BigFont rows 2 and 5
+  if (!bigcolon_shown) {
+    glcdFillRectangle(DISPLAY_COLON_X, DISPLAY_TIME_Y + 2*DISPLAY_DIGITSCALE,
+		      DISPLAY_DIGITSCALE, DISPLAY_DIGITSCALE, !inverted);
+    glcdFillRectangle(DISPLAY_COLON_X, DISPLAY_TIME_Y + 5*DISPLAY_DIGITSCALE,
+		      DISPLAY_DIGITSCALE, DISPLAY_DIGITSCALE, !inverted);
+    bigcolon_shown = 1;
+  }
+
+  for (i = 0; i < 4; i++) {
+    if (d[i] != bigdigit_shown[i]) {
+      drawbigdigit(xs[i], DISPLAY_TIME_Y, d[i], DISPLAY_DIGITSCALE, inverted);
+      bigdigit_shown[i] = d[i];
+    }
+  }
+}
+
 static unsigned char __attribute__ ((progmem)) MonthText[] = {
 	0,0,0,
 	'J','A','N',
@@ -18,12 +18,39 @@
 
 // These store the current button states for all 3 buttons. We can 
 // then query whether the buttons are pressed and released or pressed
-// This allows for 'high speed incrementing' when setting the time
-volatile uint8_t last_buttonstate = 0, just_pressed = 0, pressed = 0;
-volatile uint8_t buttonholdcounter = 0;
+// This allows for 'high speed incrementing' when setting the time.
+// event_poll() sets them from the event queue, only the main loop
+// touches them.
+uint8_t just_pressed = 0, pressed = 0;
+
+// how much a menu's '+' moves its value: 1, or 10 once it has been held
+// for BUTTON_STEP10_MS.  From the timestamps of the press and its repeats.
+uint8_t button_step = 1;
+static uint16_t button_since;
+
+// The debouncing: ADC_vect sorts every conversion (one a ms) into a
+// button and button_sample() only believes it once BUTTON_DEBOUNCE
+// of them in a row agree, so nothing waits in the interrupt.
+uint8_t button_raw = 0;		// what the last conversions said
+uint8_t button_same = 0;	// how many in a row said it
+uint8_t button_down = 0;	// the button that is down, debounced
+uint16_t button_held = 0;	// ms it has been down, up to 0xFFFF
+uint16_t button_repeat = 0;	// ms until it repeats
+
+// the last BUTTON_OVERSAMPLE conversions, and the average of them
+// from the last time they agreed
+uint16_t button_window[BUTTON_OVERSAMPLE];
+uint8_t button_next = 0;
+volatile uint16_t button_level = 1023;
+
+// where the ladder goes from one button to the next, from the top down:
+// above button_adc[0] is no button, above button_adc[1] is '+' and so on
+uint16_t button_adc[3] = { BUTTON_NONE_ADC, BUTTON_PLUS_ADC, BUTTON_SET_ADC };
+const uint8_t button_bits[4] PROGMEM = { 0, 0x4, 0x2, 0x1 };
 
 // whether hte alarm is going off
 extern volatile uint8_t alarming;
+extern volatile uint8_t displaymode;
 
 void initbuttons(void) {
   // alarm pin requires a pullup
@@ -31,114 +58,217 @@ void initbuttons(void) {
   ALARM_PORT |= _BV(ALARM);
 
   // alarm switching is detected by using the pin change interrupt
-  PCICR =  _BV(PCIE0);
+  PCICR |= _BV(PCIE0);
   PCMSK0 |= _BV(ALARM);
 
   // The buttons are totem pole'd together so we can read the buttons with one pin
   // set up ADC
   ADMUX = 2;      // listen to ADC2 for button presses
-  ADCSRB = 0;     // free running mode
-  // enable ADC and interrupts, prescale down to <200KHz
-  ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1); 
-  ADCSRA |= _BV(ADSC); // start a conversion
+  ADCSRB = _BV(ADTS1) | _BV(ADTS0); // started by timer0 compare A, once a ms
+  // enable ADC, auto trigger and interrupts, prescale down to <200KHz
+  ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1); 
+
+#ifdef BUTTON_CALIBRATE
+  if (eeprom_read_byte((uint8_t *)EE_BUTTON_CAL) == EE_INITIALIZED)
+    eeprom_read_block(button_adc, (void *)EE_BUTTON_ADC, sizeof(button_adc));
+#endif
 }
 
-uint16_t readADC(void) {
-  // basically just the busy-wait code to read the ADC and return the value
-  ADCSRA &= ~_BV(ADIE); // no interrupt
-  ADCSRA |= _BV(ADSC); // start a conversion
-  while (! (ADCSRA & _BV(ADIF)));
-  return ADC;
+#ifdef BUTTON_CALIBRATE
+// wait for the ladder to hold still between lo and hi for 200ms,
+// returns where it is or 0xFFFF if it didn't within BUTTON_CAL_MS
+static uint16_t button_settle(uint16_t lo, uint16_t hi) {
+  uint16_t level, last = 0xFFFF;
+  uint16_t ms;
+  uint8_t still = 0;
+
+  for (ms = 0; ms < BUTTON_CAL_MS; ms += 10) {
+    _delay_ms(10);
+    cli();
+    level = button_level;
+    sei();
+    if ((level >= lo) && (level < hi) &&
+	(level + BUTTON_NOISE >= last) && (level <= last + BUTTON_NOISE)) {
+      if (++still == 20)
+	return level;
+    } else {
+      still = 0;
+    }
+    last = level;
+  }
+  return 0xFFFF;
 }
 
-// Every time the ADC finishes a conversion, we'll see whether
-// the buttons have changed
-SIGNAL(ADC_vect) {
-  uint16_t reading, reading2;
+// with a button held down at power up, have each one held in turn and
+// put the thresholds half way between them.  Needs the display and
+// timer0 going.
+void button_calibrate(void) {
+  uint16_t level[4];
+  uint8_t i;
+  event_t e;
+
+  // nothing held, keep what we have
+  cli();
+  level[0] = button_level;
   sei();
+  if (level[0] >= button_adc[0])
+    return;
 
-  // We get called when ADC is ready so no need to request a conversion
-  reading = ADC;
+  glcdClearScreen();
+  glcdSetAddress(0, 0);
+  glcdPutStr("Button calibration", NORMAL);
+  glcdSetAddress(MENU_INDENT, 2);
+  glcdPutStr("Let go    ", NORMAL);
+  glcdFlush();
 
-  if (reading > 735) {
-    // no presses
-    pressed = 0;
-    last_buttonstate = 0;
-    
-    ADCSRA |= _BV(ADIE) | _BV(ADSC); // start next conversion  
-    return;
-  } else if (reading > 610) {
-    // button 3 "+" pressed
-    if (! (last_buttonstate & 0x4)) { // was not pressed before
-      // debounce by taking a second reading 
-      _delay_ms(10);
-      reading2 = readADC();
-      if ( (reading2 > 735) || (reading2 < 610)) {
-	// was a bounce, ignore it
-	ADCSRA |= _BV(ADIE) | _BV(ADSC); // start next conversion  	
-	return;
-      }
+  // nothing pressed is the top of the ladder
+  level[0] = button_settle(level[0] + BUTTON_CAL_GAP, 1024);
+  for (i = 1; (i < 4) && (level[i-1] != 0xFFFF); i++) {
+    glcdSetAddress(MENU_INDENT, 2);
+    glcdPutStr("Hold ", NORMAL);
+    glcdPutStr((i == 1) ? "+   " : ((i == 2) ? "SET " : "MENU"), NORMAL);
+    glcdFlush();
+    if (level[i-1] < BUTTON_CAL_GAP)
+      level[i] = 0xFFFF;
+    else
+      level[i] = button_settle(0, level[i-1] - BUTTON_CAL_GAP);
+    if (level[i] == 0xFFFF)
+      break;
 
-      buttonholdcounter = 2;          // see if we're press-and-holding
-      // the buttonholdcounter is decremented by a timer!
-      while (buttonholdcounter) {
-	reading2 = readADC();
-	if ( (reading2 > 735) || (reading2 < 610)) {
-	  // button was released
-	  last_buttonstate &= ~0x4;
-  
-	  DEBUG(putstring_nl("b3"));
-	  just_pressed |= 0x4;
-	  ADCSRA |= _BV(ADIE) | _BV(ADSC); // start next conversion  	
-	  return;
-	}
-      }
-      // 2 seconds later...
-      last_buttonstate |= 0x4;
-      pressed |= 0x4;                 // The button was held down (fast advance)
-    }
+    glcdSetAddress(MENU_INDENT, 2);
+    glcdPutStr("Let go    ", NORMAL);
+    glcdFlush();
+    button_settle(level[0] - BUTTON_CAL_GAP, 1024);
+  }
 
-  } else if (reading > 270) {
-    // button 2 "SET" pressed
-    if (! (last_buttonstate & 0x2)) { // was not pressed before
-      // debounce by taking a second reading 
-      _delay_ms(10);
-      reading2 = readADC();
-      if ( (reading2 > 610) || (reading2 < 270)) {
-	// was a bounce, ignore it
-	ADCSRA |= _BV(ADIE) | _BV(ADSC); // start next conversion  	
-	return;
-      }
-      DEBUG(putstring_nl("b2"));
-      just_pressed |= 0x2;
-    }
-    last_buttonstate |= 0x2;
-    pressed |= 0x2;                 // held down
-
-  } else {
-    // button 1 "MENU" pressed
-    if (! (last_buttonstate & 0x1)) { // was not pressed before
-      // debounce by taking a second reading 
-      _delay_ms(10);
-      reading2 = readADC();
-      if (reading2 > 270) {
-	// was a bounce, ignore it
-	ADCSRA |= _BV(ADIE) | _BV(ADSC); // start next conversion  	
-	return;
+  if (i == 4) {
+    for (i = 0; i < 3; i++)
+      button_adc[i] = (level[i] + level[i+1]) / 2;
+    eeprom_write_block(button_adc, (void *)EE_BUTTON_ADC, sizeof(button_adc));
+    eeprom_write_byte((uint8_t *)EE_BUTTON_CAL, EE_INITIALIZED);
+  }
+  // otherwise what we had stays, until a button is held at power up again
+
+  // the presses were only for us
+  while (event_get(&e))
+    if (e.type == EVENT_ALARMSW)
+      setalarmstate();
+  glcdClearScreen();
+}
+#endif
+
+// from the ADC interrupt, into the queue for the main loop
+static void button_event(uint8_t button, uint8_t event) {
+  event_put(event, button);
+}
+
+// take events off the queue until there is a press to deal with (one
+// at a time, so none get lost).  From task_buttons() and the menu loops.
+void event_poll(void) {
+  event_t e;
+
+  while (!just_pressed && event_get(&e)) {
+    switch (e.type) {
+    case BUTTON_PRESS:
+      just_pressed = e.data;
+      button_since = e.ms;
+      button_step = 1;
+      break;
+    case BUTTON_LONG:
+      pressed |= e.data;            // held down (fast advance)
+      break;
+    case BUTTON_RELEASE:
+      pressed &= ~e.data;
+      break;
+    case BUTTON_REPEAT:
+      // in the menus a held '+' presses itself, faster and faster
+      if ((e.data & BUTTON_REPEATS) && (displaymode != SHOW_TIME)) {
+	just_pressed = e.data;
+	if ((uint16_t)(e.ms - button_since) >= BUTTON_STEP10_MS)
+	  button_step = 10;
       }
-      DEBUG(putstring_nl("b1"));
-      just_pressed |= 0x1;
+      break;
+    case EVENT_ALARMSW:
+      setalarmstate();
+      break;
+    case EVENT_TICK:
+      clock_check();
+      break;
     }
-    last_buttonstate |= 0x1;
-    pressed |= 0x1;                 // held down
+  }
+}
+
+// one debounced ms of the buttons
+static void button_sample(uint8_t button) {
+  if (button != button_raw) {
+    // bouncing, or sliding along the ladder
+    button_raw = button;
+    button_same = 0;
+    return;
+  }
+  if (button_same < BUTTON_DEBOUNCE) {
+    button_same++;
+    return;
+  }
+
+  if (button != button_down) {
+    if (button_down)
+      button_event(button_down, BUTTON_RELEASE);
+    button_down = button;
+    button_held = 0;
+    button_repeat = BUTTON_REPEAT_MS;
+    if (button)
+      button_event(button, BUTTON_PRESS);
+    return;
+  }
+  if (! button)
+    return;
+
+  if (button_held < 0xFFFF)
+    button_held++;
+  if (button_held == BUTTON_LONG_MS)
+    button_event(button, BUTTON_LONG);
+  if (--button_repeat == 0) {
+    button_event(button, BUTTON_REPEAT);
+    if ((button_held >= BUTTON_FAST_MS) && (button_held < BUTTON_STEP10_MS))
+      button_repeat = BUTTON_REPEAT_FAST_MS;
+    else
+      button_repeat = BUTTON_REPEAT_SLOW_MS;
+  }
+}
+
+// Every time the ADC finishes a conversion, we'll see whether
+// the buttons have changed
+SIGNAL(ADC_vect) {
+  uint16_t reading, lo, hi, sum = 0;
+  uint8_t i;
 
+  button_window[button_next++ & (BUTTON_OVERSAMPLE-1)] = ADC;
+  lo = hi = button_window[0];
+  for (i = 0; i < BUTTON_OVERSAMPLE; i++) {
+    reading = button_window[i];
+    sum += reading;
+    if (reading < lo)
+      lo = reading;
+    if (reading > hi)
+      hi = reading;
+  }
+  if (hi - lo > BUTTON_NOISE) {
+    // moving, it isn't any button yet
+    button_same = 0;
+    return;
   }
-  ADCSRA |= _BV(ADIE) | _BV(ADSC); // start next conversion  
+  reading = sum / BUTTON_OVERSAMPLE;
+  button_level = reading;
+
+  // 0 (above all of them) is no button, then '+', SET and MENU
+  for (i = 0; (i < 3) && (reading <= button_adc[i]); i++)
+    ;
+  button_sample(pgm_read_byte(&button_bits[i]));
 }
 
-// We use the pin change interrupts to detect when alarm changes
+// We use the pin change interrupts to detect when alarm changes,
+// setalarmstate() looks at the pin from the main loop
 SIGNAL(PCINT0_vect) {
-  // allow interrupts while we're doing this
-  sei();
-  setalarmstate();
+  event_put(EVENT_ALARMSW, 0);
 }
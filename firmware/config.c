@@ -3,879 +3,287 @@
 // This code is distributed under the GNU Public License
 //		which can be found at http://www.gnu.org/licenses/gpl.txt
 //
+// The configuration menu is the config_menu table at the bottom, menu.c
+// runs it.  What is here is how each value is drawn, and what happens
+// when it has been set.
 **************************************************************************** */
 
 #include <avr/io.h>      // this contains all the IO port definitions
-#include <avr/interrupt.h>
-#include <util/delay.h>
 #include <avr/pgmspace.h>
-#include <avr/eeprom.h>
-#include <string.h>
 #include "util.h"
 #include "ratt.h"
 #include "ks0108.h"
 #include "glcd.h"
 
-extern volatile uint8_t time_s, time_m, time_h;
-extern volatile uint8_t date_m, date_d, date_y;
 extern volatile uint8_t alarm_h, alarm_m;
-extern volatile uint8_t last_buttonstate, just_pressed, pressed;
-extern volatile uint8_t buttonholdcounter;
 extern volatile uint8_t region;
 extern volatile uint8_t time_format;
+extern volatile uint8_t timeunknown;
+
+// the time or date while it is being set, the rest comes from the
+// clock when it is saved
+static datetime_t setting;
+// region and time_format as one: region*2 + time_format
+static uint8_t region_at;
+
+static const char month_names[12][4] PROGMEM = {
+  "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+  "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+static const char dow_names[7][5] PROGMEM = {
+  "Sun ", "Mon ", "Tue ", "Wed ", "Thu ", "Fri ", "Sat "
+};
+
+// by region_at
+static const char region_names[12][13] PROGMEM = {
+  "     US 12hr", "     US 24hr",
+  "     EU 12hr", "     EU 24hr",
+  " US 12hr DOW", " US 24hr DOW",
+  " EU 12hr DOW", " EU 24hr DOW",
+  "   12hr LONG", "   24hr LONG",
+  "12h LONG DOW", "24h LONG DOW"
+};
 
-extern volatile uint8_t displaymode;
-// This variable keeps track of whether we have not pressed any
-// buttons in a few seconds, and turns off the menu display
-volatile uint8_t timeoutcounter = 0;
-
-volatile uint8_t screenmutex = 0;
-
-void display_menu(void) {
-  DEBUGP("display menu");
-  
-  screenmutex++;
-
-  glcdClearScreen();
-  
-  glcdSetAddress(0, 0);
-  glcdPutStr("Configuration Menu", NORMAL);
-  
-  glcdSetAddress(MENU_INDENT, 1);
-  glcdPutStr("Set Alarm:  ", NORMAL);
-  print_alarmhour(alarm_h, NORMAL);
-  glcdWriteChar(':', NORMAL);
-  printnumber(alarm_m, NORMAL);
-  
-  glcdSetAddress(MENU_INDENT, 2);
-  glcdPutStr("Set Time: ", NORMAL);
-  print_timehour(time_h, NORMAL);
-  glcdWriteChar(':', NORMAL);
-  printnumber(time_m, NORMAL);
-  glcdWriteChar(':', NORMAL);
-  printnumber(time_s, NORMAL);
+void print_timehour(uint8_t h, uint8_t inverted) {
   if (time_format == TIME_12H) {
-    glcdWriteChar(' ', NORMAL);
-    if (time_h >= 12) {
-      glcdWriteChar('P', NORMAL);
+    h = bcd_hour12(h);
+    if (h >= 0x10) {
+      printbcd(h, inverted);
     } else {
-      glcdWriteChar('A', NORMAL);
+      glcdWriteChar(' ', NORMAL);
+      glcdWriteChar('0' + h, inverted);
     }
+  } else {
+    glcdWriteChar(' ', NORMAL);
+    glcdWriteChar(' ', NORMAL);
+    printbcd(h, inverted);
   }
-  
-  print_date(date_m,date_d,date_y,SET_DATE);
-  print_region_setting(NORMAL);
-  
-#ifdef BACKLIGHT_ADJUST
-  glcdSetAddress(MENU_INDENT, 5);
-  #ifndef AUTODIM
-  glcdPutStr("Set Backlight: ", NORMAL);
-  printnumber(OCR2B>>OCR2B_BITSHIFT,NORMAL);
-  #else
-  glcdPutStr("Set AutoDim", NORMAL);
-  #endif
-#endif
-  
-  glcdSetAddress(0, 6);
-  glcdPutStr("Press MENU to advance", NORMAL);
-  glcdSetAddress(0, 7);
-  glcdPutStr("Press SET to set", NORMAL);
-
-  screenmutex--;
 }
 
-void print_month(uint8_t inverted, uint8_t month) {
-  switch(month)
-  {
-  	case 1:
-  	  glcdPutStr("Jan", inverted);
-  	  break;
-  	case 2:
-  	  glcdPutStr("Feb", inverted);
-  	  break;
-  	case 3:
-  	  glcdPutStr("Mar", inverted);
-  	  break;
-  	case 4:
-  	  glcdPutStr("Apr", inverted);
-  	  break;
-  	case 5:
-  	  glcdPutStr("May", inverted);
-  	  break;
-  	case 6:
-  	  glcdPutStr("Jun", inverted);
-  	  break;
-  	case 7:
-  	  glcdPutStr("Jul", inverted);
-  	  break;
-  	case 8:
-  	  glcdPutStr("Aug", inverted);
-  	  break;
-  	case 9:
-  	  glcdPutStr("Sep", inverted);
-  	  break;
-  	case 10:
-  	  glcdPutStr("Oct", inverted);
-  	  break;
-  	case 11:
-  	  glcdPutStr("Nov", inverted);
-  	  break;
-  	case 12:
-  	  glcdPutStr("Dec", inverted);
-  	  break;
+// " A" or " P" after a 12 hour time
+void print_ampm(uint8_t h, uint8_t inverted) {
+  if (time_format == TIME_12H) {
+    glcdWriteChar(' ', NORMAL);
+    glcdWriteChar((h >= 0x12) ? 'P' : 'A', inverted);
   }
 }
-void print_dow(uint8_t inverted, uint8_t mon, uint8_t day, uint8_t yr) {
-  switch(dotw(mon,day,yr))
-  {
-    case 0:
-      glcdPutStr("Sun ", inverted);
-      break;
-    case 1:
-      glcdPutStr("Mon ", inverted);
-      break;
-    case 2:
-      glcdPutStr("Tue ", inverted);
-      break;
-    case 3:
-      glcdPutStr("Wed ", inverted);
-      break;
-    case 4:
-      glcdPutStr("Thu ", inverted);
-      break;
-    case 5:
-      glcdPutStr("Fri ", inverted);
-      break;
-    case 6:
-      glcdPutStr("Sat ", inverted);
-      break;
-    
-  }
+
+static void print_month(uint8_t month, uint8_t inverted) {
+  glcdPutStr_P(month_names[bcd2i(month) - 1], inverted);
 }
 
-void print_date(uint8_t month, uint8_t day, uint8_t year, uint8_t mode) {
-  glcdSetAddress(MENU_INDENT, 3);
-  glcdPutStr("Date:", NORMAL);
-  if (region == REGION_US) {
-  	glcdPutStr("     ",NORMAL);
-    printnumber(month, (mode == SET_MONTH)?INVERTED:NORMAL);
-    glcdWriteChar('/', NORMAL);
-    printnumber(day, (mode == SET_DAY)?INVERTED:NORMAL);
-    glcdWriteChar('/', NORMAL);
-  } else if (region == REGION_EU) {
-  	glcdPutStr("     ",NORMAL);
-    printnumber(day, (mode == SET_DAY)?INVERTED:NORMAL);
-    glcdWriteChar('/', NORMAL);
-    printnumber(month, (mode == SET_MONTH)?INVERTED:NORMAL);
-    glcdWriteChar('/', NORMAL);
-  } else if ( region == DOW_REGION_US) {
-  	glcdWriteChar(' ', NORMAL);
-  	print_dow(NORMAL,month,day,year);
-  	printnumber(month, (mode == SET_MONTH)?INVERTED:NORMAL);
-    glcdWriteChar('/', NORMAL);
-    printnumber(day, (mode == SET_DAY)?INVERTED:NORMAL);
-    glcdWriteChar('/', NORMAL);
-  } else if ( region == DOW_REGION_EU) {
-  	glcdWriteChar(' ', NORMAL);
-  	print_dow(NORMAL,month,day,year);
-  	printnumber(day, (mode == SET_DAY)?INVERTED:NORMAL);
-    glcdWriteChar('/', NORMAL);
-    printnumber(month, (mode == SET_MONTH)?INVERTED:NORMAL);
-    glcdWriteChar('/', NORMAL);
-  } else if ( region == DATELONG) {
-  	glcdPutStr("   ",NORMAL);
-  	print_month((mode == SET_MONTH)?INVERTED:NORMAL,month);
-  	glcdWriteChar(' ', NORMAL);
-  	printnumber(day, (mode == SET_DAY)?INVERTED:NORMAL);
-  	glcdWriteChar(',', NORMAL);
-  	glcdWriteChar(' ', NORMAL);
-  } else {
-  	print_dow(NORMAL,month,day,year);
-  	print_month((mode == SET_MONTH)?INVERTED:NORMAL,month);
-  	glcdWriteChar(' ', NORMAL);
-  	printnumber(day, (mode == SET_DAY)?INVERTED:NORMAL);
-  	glcdWriteChar(',', NORMAL);
-  }
-  printnumber(20,(mode == SET_YEAR)?INVERTED:NORMAL);
-  printnumber(year, (mode == SET_YEAR)?INVERTED:NORMAL);
+static void print_dow(uint8_t mon, uint8_t day, uint8_t yr) {
+  glcdPutStr_P(dow_names[dotw(bcd2i(mon), bcd2i(day), bcd2i(yr))], NORMAL);
 }
 
-void set_date(void) {
-  uint8_t mode = SET_DATE;
-  uint8_t day, month, year;
-    
-  day = date_d;
-  month = date_m;
-  year = date_y;
-
-  display_menu();
-
-  screenmutex++;
-  // put a small arrow next to 'set date'
-  drawArrow(0, 27, MENU_INDENT -1);
-  screenmutex--;
-  
-  timeoutcounter = INACTIVITYTIMEOUT;  
-
-  while (1) {
-    if (just_pressed & 0x1) { // mode change
-      return;
-    }
-    if (just_pressed || pressed) {
-      timeoutcounter = INACTIVITYTIMEOUT;  
-      // timeout w/no buttons pressed after 3 seconds?
-    } else if (!timeoutcounter) {
-      //timed out!
-      displaymode = SHOW_TIME;     
-      return;
-    }
-    if (just_pressed & 0x2) {
-      just_pressed = 0;
-      screenmutex++;
-
-      if ((mode == SET_DATE) && ((region == REGION_US) || (region == DOW_REGION_US) || (region == DATELONG) || (region == DATELONG_DOW))) {
-	DEBUG(putstring("Set date month"));
-	// ok now its selected
-	mode = SET_MONTH;
-
-	// print the month inverted
-	print_date(month,day,year,mode);
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press + to change mon", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set mon.", NORMAL);
-      } else if ((mode == SET_DATE) && ((region == REGION_EU) || (region == DOW_REGION_EU))) {
-	DEBUG(putstring("Set date month"));
-	// ok now its selected
-	mode = SET_DAY;
-
-	// print the day inverted
-	print_date(month,day,year,mode);
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press + to change day", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set date", NORMAL);
-      } else if ((mode == SET_MONTH) && ((region == REGION_US) || (region == DOW_REGION_US) || (region == DATELONG) || (region == DATELONG_DOW))) {
-	DEBUG(putstring("Set date day"));
-	mode = SET_DAY;
-
-	print_date(month,day,year,mode);
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press + to change day", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set date", NORMAL);
-      }else if ((mode == SET_DAY) && ((region == REGION_EU) || (region == DOW_REGION_EU))) {
-	DEBUG(putstring("Set date month"));
-	mode = SET_MONTH;
-
-	print_date(month,day,year,mode);
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press + to change mon", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set mon.", NORMAL);
-      } else if ( ((mode == SET_DAY) && ((region == REGION_US) || (region == DOW_REGION_US) || (region == DATELONG) || (region == DATELONG_DOW))) ||
-		  ((mode == SET_MONTH) && ((region == REGION_EU) || (region == DOW_REGION_EU))) )  {
-	DEBUG(putstring("Set year"));
-	mode = SET_YEAR;
-	// print the date normal
-
-	print_date(month,day,year,mode);
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press + to change yr.", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set year", NORMAL);
-      } else {
-	// done!
-	DEBUG(putstring("done setting date"));
-	mode = SET_DATE;
-	// print the seconds normal
-	print_date(month,day,year,mode);
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press MENU to advance", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set", NORMAL);
-	
-	date_y = year;
-	date_m = month;
-	date_d = day;
-	writei2ctime(time_s, time_m, time_h, 0, date_d, date_m, date_y);
-	init_crand();
-      }
-      screenmutex--;
-    }
-    if ((just_pressed & 0x4) || (pressed & 0x4)) {
-      just_pressed = 0;
-
-      screenmutex++;
-
-      if (mode == SET_MONTH) {
-	month++;
-	if (month >= 13)
-	  month = 1;
-	if(month == 2) {
-	  if(leapyear(year) && (day > 29))
-	  	day = 29;
-	  else if (!leapyear(year) && (day > 28))
-	  	day = 28;
-	} else if ((month == 4) || (month == 6) || (month == 9) || (month == 11)) {
-      if(day > 30)
-      	day = 30;
-	}
-	print_date(month,day,year,mode);
-	
-      }
-      if (mode == SET_DAY) {
-	day++;
-	if (day > 31)
-	  day = 1;
-	if(month == 2) {
-	  if(leapyear(year) && (day > 29))
-	  	day = 1;
-	  else if (!leapyear(year) && (day > 28))
-	  	day = 1;
-	} else if ((month == 4) || (month == 6) || (month == 9) || (month == 11)) {
-      if(day > 30)
-      	day = 1;
-	}
-	print_date(month,day,year,mode);
-      }
-      if (mode == SET_YEAR) {
-	year = (year+1) % 100;
-	print_date(month,day,year,mode);
-      }
-      screenmutex--;
-
-      if (pressed & 0x4)
-	_delay_ms(200);  
-    }
-  }
+/*************************** ALARM */
 
+static void draw_alarm(uint8_t field) {
+  print_timehour(alarm_h, field == 1);
+  glcdWriteChar(':', NORMAL);
+  printbcd(alarm_m, field == 2);
+  glcdWriteChar(' ', NORMAL);
+  glcdWriteChar(' ', NORMAL);
+  print_ampm(alarm_h, field == 1);
 }
 
-#ifdef BACKLIGHT_ADJUST
-void set_backlight(void) {
-  uint8_t mode = SET_BRIGHTNESS;
-  
-  display_menu();
-  
-  screenmutex++;
-  glcdSetAddress(0, 6);
-  glcdPutStr("Press MENU to exit   ", NORMAL);
-
-  // put a small arrow next to 'set 12h/24h'
-  drawArrow(0, 43, MENU_INDENT -1);
-  screenmutex--;
-  
-  timeoutcounter = INACTIVITYTIMEOUT;  
-
-  while (1) {
-    if (just_pressed & 0x1) { // mode change
-      return;
-    }
-    if (just_pressed || pressed) {
-      timeoutcounter = INACTIVITYTIMEOUT;  
-      // timeout w/no buttons pressed after 3 seconds?
-    } else if (!timeoutcounter) {
-      //timed out!
-      displaymode = SHOW_TIME;     
-      return;
-    }
-    if (just_pressed & 0x2) {
-    #ifdef AUTODIM
-      just_pressed = 0;
-      setBacklightAutoDim();
-      display_menu();
-      screenmutex++;
-      glcdSetAddress(0, 6);
-      glcdPutStr("Press MENU to exit   ", NORMAL);
-
-     // put a small arrow next to 'set 12h/24h'
-     drawArrow(0, 43, MENU_INDENT -1);
-     screenmutex--;
-     
-     timeoutcounter = INACTIVITYTIMEOUT;  
-    #else
-      just_pressed = 0;
-      screenmutex++;
-
-      if (mode == SET_BRIGHTNESS) {
-	DEBUG(putstring("Setting backlight"));
-	// ok now its selected
-	mode = SET_BRT;
-	// print the region selected
-	glcdSetAddress(MENU_INDENT + 15*6, 5);
-	printnumber(OCR2B>>OCR2B_BITSHIFT,INVERTED);
-	
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press + to change   ", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to save   ", NORMAL);
-      } else {
-	mode = SET_BRIGHTNESS;
-	// print the region normal
-	glcdSetAddress(MENU_INDENT + 15*6, 5);
-	printnumber(OCR2B>>OCR2B_BITSHIFT,NORMAL);
-
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press MENU to exit", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set   ", NORMAL);
-      }
-      screenmutex--;
-   #endif
-    }
-    if ((just_pressed & 0x4) || (pressed & 0x4)) {
-      just_pressed = 0;
-      
-      if (mode == SET_BRT) {
-	    OCR2B += OCR2B_PLUS;
-	    if(OCR2B > OCR2A_VALUE)
-	      OCR2B = 0;
-	screenmutex++;
-	display_menu();
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press + to change    ", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to save    ", NORMAL);
-
-	// put a small arrow next to 'set 12h/24h'
-	drawArrow(0, 43, MENU_INDENT -1);
-	glcdSetAddress(MENU_INDENT + 15*6, 5);
-	printnumber(OCR2B>>OCR2B_BITSHIFT,INVERTED);
-	
-	screenmutex--;
-
-	eeprom_write_byte((uint8_t *)EE_BRIGHT, OCR2B);
-      }
-    }
-  }
+static const menu_field_t alarm_fields[] PROGMEM = {
+  { &alarm_h, 0, 0x23, 1, MENU_BCD, EE_ALARM_HOUR },
+  { &alarm_m, 0, 0x59, 1, MENU_BCD, EE_ALARM_MIN },
+};
+
+/*************************** TIME */
+
+// the clock, or what it is being set to
+static void draw_time(uint8_t field) {
+  datetime_t t = setting;
+
+  if (! field)
+    get_time_snapshot(&t);
+  print_timehour(t.h, field == 1);
+  glcdWriteChar(':', NORMAL);
+  printbcd(t.m, field == 2);
+  glcdWriteChar(':', NORMAL);
+  printbcd(t.s, field == 3);
+  print_ampm(t.h, field == 1);
 }
-#endif
 
-void print_region_setting(uint8_t inverted) {
-  glcdSetAddress(MENU_INDENT, 4);
-  glcdPutStr("Region: ", NORMAL);
-  if ((region == REGION_US) && (time_format == TIME_12H)) {
-    glcdPutStr("     US 12hr", inverted);
-  } else if ((region == REGION_US) && (time_format == TIME_24H)) {
-    glcdPutStr("     US 24hr", inverted);
-  } else if ((region == REGION_EU) && (time_format == TIME_12H)) {
-    glcdPutStr("     EU 12hr", inverted);
-  } else if ((region == REGION_EU) && (time_format == TIME_24H)){
-    glcdPutStr("     EU 24hr", inverted);
-  } else if ((region == DOW_REGION_US) && (time_format == TIME_12H)) {
-    glcdPutStr(" US 12hr DOW", inverted);
-  } else if ((region == DOW_REGION_US) && (time_format == TIME_24H)) {
-    glcdPutStr(" US 24hr DOW", inverted);
-  } else if ((region == DOW_REGION_EU) && (time_format == TIME_12H)) {
-    glcdPutStr(" EU 12hr DOW", inverted);
-  } else if ((region == DOW_REGION_EU) && (time_format == TIME_24H)){
-    glcdPutStr(" EU 24hr DOW", inverted);
-  } else if ((region == DATELONG) && (time_format == TIME_12H)) {
-    glcdPutStr("   12hr LONG", inverted);
-  } else if ((region == DATELONG) && (time_format == TIME_24H)) {
-    glcdPutStr("   24hr LONG", inverted);
-  } else if ((region == DATELONG_DOW) && (time_format == TIME_12H)) {
-    glcdPutStr("12h LONG DOW", inverted);
-  } else if ((region == DATELONG_DOW) && (time_format == TIME_24H)){
-    glcdPutStr("24h LONG DOW", inverted);
-  }
+static void load_clock(void) {
+  get_time_snapshot(&setting);
 }
 
-void set_region(void) {
-  uint8_t mode = SET_REGION;
+static void save_time(void) {
+  datetime_t now;
+
+  // the date may have gone on while the time was set
+  get_time_snapshot(&now);
+  now.h = setting.h;
+  now.m = setting.m;
+  now.s = setting.s;
+  rtc_set(&now);
+  init_crand();
+  timeunknown = 0;
+}
 
-  display_menu();
-  
-  screenmutex++;
-  
-#ifndef BACKLIGHT_ADJUST
-  glcdSetAddress(0, 6);
-  glcdPutStr("Press MENU to exit   ", NORMAL);
-#endif
+static const menu_field_t time_fields[] PROGMEM = {
+  { &setting.h, 0, 0x23, 1, MENU_BCD, MENU_NO_EE },
+  { &setting.m, 0, 0x59, 1, MENU_BCD, MENU_NO_EE },
+  { &setting.s, 0, 0x59, 1, MENU_BCD, MENU_NO_EE },
+};
 
-  // put a small arrow next to 'set 12h/24h'
-  drawArrow(0, 35, MENU_INDENT -1);
-  screenmutex--;
-  
-  timeoutcounter = INACTIVITYTIMEOUT;  
+/*************************** DATE */
 
-  while (1) {
-    if (just_pressed & 0x1) { // mode change
-      return;
-    }
-    if (just_pressed || pressed) {
-      timeoutcounter = INACTIVITYTIMEOUT;  
-      // timeout w/no buttons pressed after 3 seconds?
-    } else if (!timeoutcounter) {
-      //timed out!
-      displaymode = SHOW_TIME;     
-      return;
-    }
-  
-    if (just_pressed & 0x2) {
-      just_pressed = 0;
-      screenmutex++;
-
-      if (mode == SET_REGION) {
-	DEBUG(putstring("Setting region"));
-	// ok now its selected
-	mode = SET_REG;
-	// print the region 
-	print_region_setting(INVERTED);
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press + to change    ", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to save    ", NORMAL);
-      } else {
-	mode = SET_REGION;
-	// print the region normal
-	print_region_setting(NORMAL);
-
-	glcdSetAddress(0, 6);
-#ifdef BACKLIGHT_ADJUST
-	glcdPutStr("Press MENU to advance", NORMAL);
-#else
-	glcdPutStr("Press MENU to exit   ", NORMAL);
-#endif
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set     ", NORMAL);
-      }
-      screenmutex--;
+static uint8_t day_first(void) {
+  return (region == REGION_EU) || (region == DOW_REGION_EU);
+}
+
+// fields 1, 2 and 3 are the month, day and year, all 15 characters wide
+static void draw_date(uint8_t field) {
+  datetime_t t = setting;
+
+  if (! field)
+    get_time_snapshot(&t);
+  if ((region == REGION_US) || (region == REGION_EU) ||
+      (region == DOW_REGION_US) || (region == DOW_REGION_EU)) {
+    if (region >= DOW_REGION_US) {
+      glcdWriteChar(' ', NORMAL);
+      print_dow(t.mo, t.d, t.y);
+    } else {
+      glcdPutStr_P(PSTR("     "), NORMAL);
     }
-    if ((just_pressed & 0x4) || (pressed & 0x4)) {
-      just_pressed = 0;
-      
-      if (mode == SET_REG) {
-	    if(time_format) {        
-	      region++;
-	      if(region > DATELONG_DOW)
-	        region = 0;
-		  time_format = !time_format;
-		} else {
-		  time_format = !time_format;
-		}
-	screenmutex++;
-	display_menu();
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press + to change    ", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to save    ", NORMAL);
-
-	// put a small arrow next to 'set 12h/24h'
-	drawArrow(0, 35, MENU_INDENT -1);
-
-	print_region_setting(INVERTED);
-	screenmutex--;
-
-	eeprom_write_byte((uint8_t *)EE_REGION, region);
-	eeprom_write_byte((uint8_t *)EE_TIME_FORMAT, time_format);    
-      }
+    if (day_first()) {
+      printbcd(t.d, field == 2);
+      glcdWriteChar('/', NORMAL);
+      printbcd(t.mo, field == 1);
+    } else {
+      printbcd(t.mo, field == 1);
+      glcdWriteChar('/', NORMAL);
+      printbcd(t.d, field == 2);
     }
+    glcdWriteChar('/', NORMAL);
+  } else {
+    if (region == DATELONG)
+      glcdPutStr_P(PSTR("   "), NORMAL);
+    else
+      print_dow(t.mo, t.d, t.y);
+    print_month(t.mo, field == 1);
+    glcdWriteChar(' ', NORMAL);
+    printbcd(t.d, field == 2);
+    glcdWriteChar(',', NORMAL);
+    if (region == DATELONG)
+      glcdWriteChar(' ', NORMAL);
   }
+  printbcd(0x20, field == 3);
+  printbcd(t.y, field == 3);
 }
 
-void set_alarm(void) {
-  uint8_t mode = SET_ALARM;
+// the day before the month where it is written that way
+static uint8_t date_order(uint8_t n) {
+  if ((n < 3) && day_first())
+    return 3 - n;
+  return n;
+}
 
-  display_menu();
-  screenmutex++;
-  // put a small arrow next to 'set alarm'
-  drawArrow(0, 11, MENU_INDENT -1);
-  screenmutex--;
-  timeoutcounter = INACTIVITYTIMEOUT;  
+// keep the day in the month: a new month (or year) cuts it short, the
+// day itself goes round to 1
+static void date_changed(uint8_t field) {
+  uint8_t days = month_days(setting.mo, setting.y);
 
-  while (1) {
-    if (just_pressed & 0x1) { // mode change
-      return;
-    }
-    if (just_pressed || pressed) {
-      timeoutcounter = INACTIVITYTIMEOUT;  
-      // timeout w/no buttons pressed after 3 seconds?
-    } else if (!timeoutcounter) {
-      //timed out!
-      displaymode = SHOW_TIME;     
-      return;
-    }
-    if (just_pressed & 0x2) {
-      just_pressed = 0;
-      screenmutex++;
-
-      if (mode == SET_ALARM) {
-	DEBUG(putstring("Set alarm hour"));
-	// ok now its selected
-	mode = SET_HOUR;
-
-	// print the hour inverted
-	print_alarmhour(alarm_h, INVERTED);
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press + to change hr.", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set hour", NORMAL);
-      } else if (mode == SET_HOUR) {
-	DEBUG(putstring("Set alarm min"));
-	mode = SET_MIN;
-	// print the hour normal
-	glcdSetAddress(MENU_INDENT + 12*6, 1);
-	print_alarmhour(alarm_h, NORMAL);
-	// and the minutes inverted
-	glcdSetAddress(MENU_INDENT + 15*6, 1);
-	printnumber(alarm_m, INVERTED);
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press + to change min", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set mins", NORMAL);
-
-      } else {
-	mode = SET_ALARM;
-	// print the hour normal
-	glcdSetAddress(MENU_INDENT + 12*6, 1);
-	print_alarmhour(alarm_h, NORMAL);
-	// and the minutes inverted
-	glcdSetAddress(MENU_INDENT + 15*6, 1);
-	printnumber(alarm_m, NORMAL);
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press MENU to advance", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set", NORMAL);
-      }
-      screenmutex--;
-    }
-    if ((just_pressed & 0x4) || (pressed & 0x4)) {
-      just_pressed = 0;
-      screenmutex++;
-
-      if (mode == SET_HOUR) {
-	alarm_h = (alarm_h+1) % 24;
-	// print the hour inverted
-	print_alarmhour(alarm_h, INVERTED);
-	eeprom_write_byte((uint8_t *)EE_ALARM_HOUR, alarm_h);    
-      }
-      if (mode == SET_MIN) {
-	alarm_m = (alarm_m+1) % 60;
-	glcdSetAddress(MENU_INDENT + 15*6, 1);
-	printnumber(alarm_m, INVERTED);
-	eeprom_write_byte((uint8_t *)EE_ALARM_MIN, alarm_m);    
-      }
-      screenmutex--;
-      if (pressed & 0x4)
-	_delay_ms(200);
-    }
-  }
+  if (setting.d > days)
+    setting.d = (field == 2) ? 1 : days;
 }
 
-void set_time(void) {
-  uint8_t mode = SET_TIME;
-
-  uint8_t hour, min, sec;
-    
-  hour = time_h;
-  min = time_m;
-  sec = time_s;
-
-  display_menu();
-  
-  screenmutex++;
-  // put a small arrow next to 'set time'
-  drawArrow(0, 19, MENU_INDENT -1);
-  screenmutex--;
- 
-  timeoutcounter = INACTIVITYTIMEOUT;  
-
-  while (1) {
-    if (just_pressed & 0x1) { // mode change
-      return;
-    }
-    if (just_pressed || pressed) {
-      timeoutcounter = INACTIVITYTIMEOUT;  
-      // timeout w/no buttons pressed after 3 seconds?
-    } else if (!timeoutcounter) {
-      //timed out!
-      displaymode = SHOW_TIME;     
-      return;
-    }
-    if (just_pressed & 0x2) {
-      just_pressed = 0;
-      screenmutex++;
-
-      if (mode == SET_TIME) {
-	DEBUG(putstring("Set time hour"));
-	// ok now its selected
-	mode = SET_HOUR;
-
-	// print the hour inverted
-	glcdSetAddress(MENU_INDENT + 10*6, 2);
-	print_timehour(hour, INVERTED);
-	glcdSetAddress(MENU_INDENT + 18*6, 2);
-	if (time_format == TIME_12H) {
-	  glcdWriteChar(' ', NORMAL);
-	  if (hour >= 12) {
-	    glcdWriteChar('P', INVERTED);
-	  } else {
-	    glcdWriteChar('A', INVERTED);
-	  }
-	}
-
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press + to change hr.", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set hour", NORMAL);
-      } else if (mode == SET_HOUR) {
-	DEBUG(putstring("Set time min"));
-	mode = SET_MIN;
-	// print the hour normal
-	glcdSetAddress(MENU_INDENT + 10*6, 2);
-	print_timehour(hour, NORMAL);
-	// and the minutes inverted
-	glcdWriteChar(':', NORMAL);
-	printnumber(min, INVERTED);
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press + to change min", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set mins", NORMAL);
-
-	glcdSetAddress(MENU_INDENT + 18*6, 2);
-	if (time_format == TIME_12H) {
-	  glcdWriteChar(' ', NORMAL);
-	  if (hour >= 12) {
-	    glcdWriteChar('P', NORMAL);
-	  } else {
-	    glcdWriteChar('A', NORMAL);
-	  }
-	}
-      } else if (mode == SET_MIN) {
-	DEBUG(putstring("Set time sec"));
-	mode = SET_SEC;
-	// and the minutes normal
-	if(time_format == TIME_12H) {
-	  glcdSetAddress(MENU_INDENT + 13*6, 2);
-	} else {
-	  glcdSetAddress(MENU_INDENT + 15*6, 2);
-	}
-	printnumber(min, NORMAL);
-	glcdWriteChar(':', NORMAL);
-	// and the seconds inverted
-	printnumber(sec, INVERTED);
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press + to change sec", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set secs", NORMAL);
-      } else {
-	// done!
-	DEBUG(putstring("done setting time"));
-	mode = SET_TIME;
-	// print the seconds normal
-	if(time_format == TIME_12H) {
-	  glcdSetAddress(MENU_INDENT + 16*6, 2);
-	} else {
-  	  glcdSetAddress(MENU_INDENT + 18*6, 2);
-	}
-	printnumber(sec, NORMAL);
-	// display instructions below
-	glcdSetAddress(0, 6);
-	glcdPutStr("Press MENU to advance", NORMAL);
-	glcdSetAddress(0, 7);
-	glcdPutStr("Press SET to set", NORMAL);
-	
-	time_h = hour;
-	time_m = min;
-	time_s = sec;
-	writei2ctime(time_s, time_m, time_h, 0, date_d, date_m, date_y);
-	init_crand();
-      }
-      screenmutex--;
-    }
-    if ((just_pressed & 0x4) || (pressed & 0x4)) {
-      just_pressed = 0;
-      screenmutex++;
-      if (mode == SET_HOUR) {
-	hour = (hour+1) % 24;
-	time_h = hour;
-	
-	glcdSetAddress(MENU_INDENT + 10*6, 2);
-	print_timehour(hour, INVERTED);
-	glcdSetAddress(MENU_INDENT + 18*6, 2);
-	if (time_format == TIME_12H) {
-	  glcdWriteChar(' ', NORMAL);
-	  if (time_h >= 12) {
-	    glcdWriteChar('P', INVERTED);
-	  } else {
-	    glcdWriteChar('A', INVERTED);
-	  }
-	}
-      }
-      if (mode == SET_MIN) {
-	min = (min+1) % 60;
-	if(time_format == TIME_12H) {
-	  glcdSetAddress(MENU_INDENT + 13*6, 2);
-	} else {
-	  glcdSetAddress(MENU_INDENT + 15*6, 2);
-	}
-	printnumber(min, INVERTED);
-      }
-      if (mode == SET_SEC) {
-	sec = (sec+1) % 60;
-	if(time_format == TIME_12H) {
-	  glcdSetAddress(MENU_INDENT + 16*6, 2);
-	} else {
-	  glcdSetAddress(MENU_INDENT + 18*6, 2);
-	}
-	printnumber(sec, INVERTED);
-      }
-      screenmutex--;
-      if (pressed & 0x4)
-	_delay_ms(200);
-    }
-  }
+static void save_date(void) {
+  datetime_t now;
+
+  // the time went on while the date was set
+  get_time_snapshot(&now);
+  now.y = setting.y;
+  now.mo = setting.mo;
+  now.d = setting.d;
+  rtc_set(&now);
+  init_crand();
 }
 
-void print_timehour(uint8_t h, uint8_t inverted) {
-  if (time_format == TIME_12H) {
-    if (((h + 23)%12 + 1) >= 10 ) {
-      printnumber((h + 23)%12 + 1, inverted);
-    } else {
-      glcdWriteChar(' ', NORMAL);
-      glcdWriteChar('0' + (h + 23)%12 + 1, inverted);
-    }
-  } else {
-    glcdWriteChar(' ', NORMAL);
-    glcdWriteChar(' ', NORMAL);
-    printnumber(h, inverted);
-  }
+static const menu_field_t date_fields[] PROGMEM = {
+  { &setting.mo, 1, 0x12, 1, MENU_BCD, MENU_NO_EE },
+  { &setting.d, 1, 0x31, 1, MENU_BCD, MENU_NO_EE },
+  { &setting.y, 0, 0x99, 1, MENU_BCD, MENU_NO_EE },
+};
+
+/*************************** REGION */
+
+static void draw_region(uint8_t field) {
+  glcdPutStr_P(region_names[region*2 + time_format], field);
 }
 
-void print_alarmhour(uint8_t h, uint8_t inverted) {
-  if (time_format == TIME_12H) {
-    glcdSetAddress(MENU_INDENT + 18*6, 1);
-    if (h >= 12) 
-      glcdWriteChar('P', NORMAL);
-    else
-      glcdWriteChar('A', NORMAL);
-    glcdWriteChar('M', NORMAL);
-    glcdSetAddress(MENU_INDENT + 12*6, 1);
+static void load_region(void) {
+  region_at = region*2 + time_format;
+}
 
-    if (((h + 23)%12 + 1) >= 10 ) {
-      printnumber((h + 23)%12 + 1, inverted);
-    } else {
-      glcdWriteChar(' ', NORMAL);
-      glcdWriteChar('0' + (h + 23)%12 + 1, inverted);
-    }
-   } else {
-    glcdSetAddress(MENU_INDENT + 12*6, 1);
-    printnumber(h, inverted);
-  }
+// the time and date on the page change with it (MENU_REDRAW)
+static void region_changed(uint8_t field) {
+  region = region_at >> 1;
+  time_format = region_at & 1;
+}
+
+static void save_region(void) {
+  menu_ee_update(EE_REGION, region);
+  menu_ee_update(EE_TIME_FORMAT, time_format);
+}
+
+static const menu_field_t region_fields[] PROGMEM = {
+  { &region_at, 0, DATELONG_DOW*2 + TIME_24H, 1, 0, MENU_NO_EE },
+};
+
+/*************************** BACKLIGHT */
+
+#if defined(BACKLIGHT_ADJUST) && !defined(AUTODIM)
+static void draw_backlight(uint8_t field) {
+  printnumber3(OCR2B, field);
 }
+
+static const menu_field_t backlight_fields[] PROGMEM = {
+  { &OCR2B, 0, BRIGHT_MAX, BRIGHT_STEP, 0, EE_BRIGHT },
+};
+#endif
+
+/*************************** THE MENU */
+
+static const char config_title[] PROGMEM = "Configuration Menu";
+static const char alarm_label[] PROGMEM = "Set Alarm:";
+static const char time_label[] PROGMEM = "Set Time:";
+static const char date_label[] PROGMEM = "Date:";
+static const char region_label[] PROGMEM = "Region:";
+#ifdef BACKLIGHT_ADJUST
+#ifdef AUTODIM
+static const char backlight_label[] PROGMEM = "Set AutoDim";
+#else
+static const char backlight_label[] PROGMEM = "Set Backlight:";
+#endif
+#endif
+
+static const menu_item_t config_items[] PROGMEM = {
+  { alarm_label, 1, MENU_INDENT + 11*6, SET_ALARM, 0,
+    2, alarm_fields, draw_alarm, 0, 0, 0, 0, 0 },
+  { time_label, 2, MENU_INDENT + 10*6, SET_TIME, MENU_LIVE,
+    3, time_fields, draw_time, 0, load_clock, 0, save_time, 0 },
+  { date_label, 3, MENU_INDENT + 5*6, SET_DATE, MENU_LIVE,
+    3, date_fields, draw_date, date_order, load_clock, date_changed, save_date, 0 },
+  { region_label, 4, MENU_INDENT + 8*6, SET_REGION, MENU_REDRAW,
+    1, region_fields, draw_region, 0, load_region, region_changed, save_region, 0 },
+#ifdef BACKLIGHT_ADJUST
+#ifdef AUTODIM
+  { backlight_label, 5, 0, SET_BRIGHTNESS, 0,
+    0, 0, 0, 0, 0, 0, 0, &autodim_menu },
+#else
+  { backlight_label, 5, MENU_INDENT + 15*6, SET_BRIGHTNESS, 0,
+    1, backlight_fields, draw_backlight, 0, 0, 0, 0, 0 },
+#endif
+#endif
+};
+
+const menu_t config_menu PROGMEM = {
+  config_title, sizeof(config_items) / sizeof(config_items[0]), config_items
+};
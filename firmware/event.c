@@ -0,0 +1,67 @@
+/* ***************************************************************************
+// event.c - the queue of input events from the interrupts to the main loop
+// This code is distributed under the GNU Public License
+//		which can be found at http://www.gnu.org/licenses/gpl.txt
+//
+// A ring of EVENT_QUEUE events with 8 bit head and tail counts that run
+// round freely.  Only the interrupts put events in (the ADC's buttons,
+// the alarm switch, the RTC's second) and they don't interrupt each other,
+// so there is one writer, which only moves the head; the main loop is the
+// one reader and only moves the tail.  Neither has to turn interrupts off.
+// The event types are in ratt.h.
+**************************************************************************** */
+
+#include <avr/io.h>
+#include "util.h"
+#include "ratt.h"
+
+// a power of 2, at most 128
+#define EVENT_QUEUE 16
+
+extern volatile uint32_t uptime;
+
+static volatile event_t event_queue[EVENT_QUEUE];
+static volatile uint8_t event_head = 0;	// where the next one goes
+static volatile uint8_t event_tail = 0;	// the next one out
+// events dropped because the queue was full
+volatile uint8_t event_lost = 0;
+
+// from an interrupt, returns 0 if the queue was full
+uint8_t event_put(uint8_t type, uint8_t data) {
+  uint8_t head = event_head;
+  volatile event_t *e;
+
+  if ((uint8_t)(head - event_tail) >= EVENT_QUEUE) {
+    event_lost++;
+    return 0;
+  }
+  e = &event_queue[head & (EVENT_QUEUE-1)];
+  e->type = type;
+  e->data = data;
+  e->ms = uptime;
+  // the event is all there before the main loop can see it
+  event_head = head + 1;
+  sched_ready(TASK_BUTTONS);
+  return 1;
+}
+
+// from the main loop, returns 0 if there was nothing
+uint8_t event_get(event_t *e) {
+  uint8_t tail = event_tail;
+  volatile event_t *q;
+
+  if (tail == event_head)
+    return 0;
+  q = &event_queue[tail & (EVENT_QUEUE-1)];
+  e->type = q->type;
+  e->data = q->data;
+  e->ms = q->ms;
+  // only now may the slot be written again
+  event_tail = tail + 1;
+  return 1;
+}
+
+// anything waiting?
+uint8_t event_waiting(void) {
+  return event_tail != event_head;
+}
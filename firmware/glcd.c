@@ -35,6 +35,9 @@
 
 #include "util.h"
 
+static void glcdFillRam(u08 x, u08 y, u08 a, u08 b, u08 color);
+static void glcdBlitFrom(u08 x, u08 y, u08 w, u08 h, const u08 *bitmap, const u08 *mask_P, u08 mode, u08 from);
+
 
 
 
@@ -43,38 +46,200 @@
 // set dot
 void glcdSetDot(u08 x, u08 y)
 {
+#ifdef GLCD_SHADOW_BUFFER
+	if((x >= GLCD_XPIXELS) || (y >= GLCD_YPIXELS))
+		return;
+	y = glcdRamLine(y);
+	GrLcdBuffer[y/8][x] |= (1 << (y % 8));
+	glcdBufferDirty(y/8, x, x);
+#else
 	unsigned char temp;
 
 	//putstring("->addr "); uart_putw_dec(x);
 	//putstring(", "); uart_putw_dec(y/8);
 	//putstring_nl(")");
 
-	glcdSetAddress(x, y/8);
+	y = glcdRamLine(y);
+	glcdSetRamAddress(x, y/8);
 	temp = glcdDataRead();	// dummy read
 	temp = glcdDataRead();	// read back current value
-	glcdSetAddress(x, y/8);
+	glcdSetRamAddress(x, y/8);
 	glcdDataWrite(temp | (1 << (y % 8)));
-	glcdStartLine(0);
+#endif
 }
 
 // clear dot
 void glcdClearDot(u08 x, u08 y)
 {
+#ifdef GLCD_SHADOW_BUFFER
+	if((x >= GLCD_XPIXELS) || (y >= GLCD_YPIXELS))
+		return;
+	y = glcdRamLine(y);
+	GrLcdBuffer[y/8][x] &= ~(1 << (y % 8));
+	glcdBufferDirty(y/8, x, x);
+#else
 	unsigned char temp;
 
-	glcdSetAddress(x, y/8);
+	y = glcdRamLine(y);
+	glcdSetRamAddress(x, y/8);
 	temp = glcdDataRead();	// dummy read
 	temp = glcdDataRead();	// read back current value
-	glcdSetAddress(x, y/8);
+	glcdSetRamAddress(x, y/8);
 	glcdDataWrite(temp & ~(1 << (y % 8)));
+#endif
+}
 
-	glcdStartLine(0);
+// set (ON) or clear (OFF) the bits in <mask> of one display ram byte
+static void glcdMaskByte(u08 x, u08 page, u08 mask, u08 color)
+{
+#ifdef GLCD_SHADOW_BUFFER
+  if (color == ON)
+    GrLcdBuffer[page][x] |= mask;
+  else
+    GrLcdBuffer[page][x] &= ~mask;
+  glcdBufferDirty(page, x, x);
+#else
+  unsigned char temp;
+
+  glcdSetRamAddress(x, page);
+  temp = glcdDataRead();	// dummy read
+  temp = glcdDataRead();	// read back current value
+  glcdSetRamAddress(x, page);
+  if (color == ON)
+    glcdDataWrite(temp | mask);
+  else
+    glcdDataWrite(temp & ~mask);
+#endif
 }
 
 // draw line
-void glcdLine(u08 x1, u08 y1, u08 x2, u08 y2)
+void glcdLine(u08 x1, u08 y1, u08 x2, u08 y2, u08 color)
+{
+  u08 dx, dy, t;
+  s08 sy;
+  int err, e2;
+
+  // straight lines are much cheaper as spans
+  if (y1 == y2) {
+    if (x1 > x2) {
+      t = x1; x1 = x2; x2 = t;
+    }
+    glcdHLine(x1, y1, x2 - x1 + 1, color);
+    return;
+  }
+  if (x1 == x2) {
+    if (y1 > y2) {
+      t = y1; y1 = y2; y2 = t;
+    }
+    glcdVLine(x1, y1, y2 - y1 + 1, color);
+    return;
+  }
+
+  // always step left to right
+  if (x1 > x2) {
+    t = x1; x1 = x2; x2 = t;
+    t = y1; y1 = y2; y2 = t;
+  }
+  dx = x2 - x1;
+  if (y2 > y1) {
+    dy = y2 - y1;
+    sy = 1;
+  } else {
+    dy = y1 - y2;
+    sy = -1;
+  }
+
+  // integer bresenham, err tracks (distance off the line) * 2
+  err = (int)dx - dy;
+  while (1) {
+    if (color == ON)
+      glcdSetDot(x1, y1);
+    else
+      glcdClearDot(x1, y1);
+    if ((x1 == x2) && (y1 == y2))
+      break;
+    // both steps go by where err was before either of them
+    e2 = 2*err;
+    if (e2 > -(int)dy) {
+      err -= dy;
+      x1++;
+    }
+    if (e2 < (int)dx) {
+      err += dx;
+      y1 += sy;
+    }
+  }
+}
+
+// draw horizontal line, one bit ORed across a run of columns
+void glcdHLine(u08 x, u08 y, u08 w, u08 color)
 {
-};
+  u08 i, page, bit;
+#ifndef GLCD_SHADOW_BUFFER
+  u08 n;
+  u08 col[GLCD_CONTROLLER_XPIXELS];
+#endif
+
+  if ((x >= GLCD_XPIXELS) || (y >= GLCD_YPIXELS) || !w)
+    return;
+  if (w > GLCD_XPIXELS - x)
+    w = GLCD_XPIXELS - x;
+  y = glcdRamLine(y);
+  page = y/8;
+  bit = _BV(y%8);
+
+#ifdef GLCD_SHADOW_BUFFER
+  for (i=0; i<w; i++) {
+    if (color == ON)
+      GrLcdBuffer[page][x+i] |= bit;
+    else
+      GrLcdBuffer[page][x+i] &= ~bit;
+  }
+  glcdBufferDirty(page, x, x+w-1);
+#else
+  // read the run back and write it out again, once per controller
+  while (w) {
+    n = GLCD_CONTROLLER_XPIXELS - (x & (GLCD_CONTROLLER_XPIXELS-1));
+    if (n > w)
+      n = w;
+    glcdSetRamAddress(x, page);
+    glcdDataRead();		// dummy read
+    for (i=0; i<n; i++) {
+      if (color == ON)
+	col[i] = glcdDataRead() | bit;
+      else
+	col[i] = glcdDataRead() & ~bit;
+    }
+    glcdSetRamAddress(x, page);
+    glcdDataWriteBurst(col, n);
+    x += n;
+    w -= n;
+  }
+#endif
+}
+
+// draw vertical line, whole page bytes at a time
+void glcdVLine(u08 x, u08 y, u08 h, u08 color)
+{
+  u08 n;
+
+  if ((x >= GLCD_XPIXELS) || (y >= GLCD_YPIXELS) || !h)
+    return;
+  if (h > GLCD_YPIXELS - y)
+    h = GLCD_YPIXELS - y;
+  y = glcdRamLine(y);
+
+  while (h) {
+    // the bits of this page from line y down, but no more than h
+    n = 8 - (y%8);
+    if (n > h)
+      n = h;
+    glcdMaskByte(x, y/8, (0xFF >> (8-n)) << (y%8), color);
+    h -= n;
+    // display ram wraps round when scrolled
+    y = (y + n) & (GLCD_YPIXELS-1);
+  }
+}
 
 // draw rectangle
 void glcdRectangle(u08 x, u08 y, u08 w, u08 h)
@@ -94,18 +259,39 @@ void glcdRectangle(u08 x, u08 y, u08 w, u08 h)
 */
   // optimized!
   
-  glcdFillRectangle(x, y, 1, h, ON);
-  glcdFillRectangle(x+w-1, y, 1, h, ON);
-  glcdFillRectangle(x, y, w, 1, ON);
-  glcdFillRectangle(x, y+h-1, w, 1, ON);
+  glcdVLine(x, y, h, ON);
+  glcdVLine(x+w-1, y, h, ON);
+  glcdHLine(x, y, w, ON);
+  glcdHLine(x, y+h-1, w, ON);
 }
 
 
 // draw filled rectangle
 void glcdFillRectangle(u08 x, u08 y, u08 a, u08 b, u08 color)
+{
+  u08 r;
+
+  if ((y >= GLCD_YPIXELS) || !b)
+    return;
+  if (b > GLCD_YPIXELS - y)
+    b = GLCD_YPIXELS - y;
+  // the rows may wrap round the bottom of display ram when scrolled
+  r = glcdRamLine(y);
+  if (b > GLCD_YPIXELS - r) {
+    glcdFillRam(x, r, a, GLCD_YPIXELS - r, color);
+    glcdFillRam(x, 0, a, b - (GLCD_YPIXELS - r), color);
+  } else {
+    glcdFillRam(x, r, a, b, color);
+  }
+}
+
+// fill rectangle given in display ram lines, not scrolled
+static void glcdFillRam(u08 x, u08 y, u08 a, u08 b, u08 color)
 {
   unsigned char i, j, temp, bitsleft;
+#ifndef GLCD_SHADOW_BUFFER
   signed char k;
+#endif
 
   /*
 // slow :(
@@ -174,10 +360,33 @@ void glcdFillRectangle(u08 x, u08 y, u08 a, u08 b, u08 color)
   }
   */
 
+#ifdef GLCD_SHADOW_BUFFER
+  // straight into the buffer, one mask per page
+  if ((x >= GLCD_XPIXELS) || (y >= GLCD_YPIXELS) || !a || !b)
+    return;
+  if (a > GLCD_XPIXELS - x)
+    a = GLCD_XPIXELS - x;
+  if (b > GLCD_YPIXELS - y)
+    b = GLCD_YPIXELS - y;
+  for (j=y/8; j <= (y+b-1)/8; j++) {
+    temp = 0xFF;
+    if (j == y/8)
+      temp &= 0xFF << (y%8);
+    if (j == (y+b-1)/8)
+      temp &= 0xFF >> (7 - (y+b-1)%8);
+    for (i=0; i<a; i++) {
+      if (color == ON)
+	GrLcdBuffer[j][x+i] |= temp;
+      else
+	GrLcdBuffer[j][x+i] &= ~temp;
+    }
+    glcdBufferDirty(j, x, x+a-1);
+  }
+#else
   // fastest!
   if (y%8) {
     for (i=0; i<a; i++) {
-      glcdSetAddress(x+i, y/8);
+      glcdSetRamAddress(x+i, y/8);
       temp = glcdDataRead();	// dummy read
       temp = glcdDataRead();	// read back current value
       // not on a perfect boundary
@@ -187,7 +396,7 @@ void glcdFillRectangle(u08 x, u08 y, u08 a, u08 b, u08 color)
 	else
 	  temp &= ~_BV(k);
       }
-      glcdSetAddress(x+i, y/8);
+      glcdSetRamAddress(x+i, y/8);
       glcdDataWrite(temp);
     } 
     // we did top section so remove it
@@ -201,19 +410,17 @@ void glcdFillRectangle(u08 x, u08 y, u08 a, u08 b, u08 color)
   }
   // skip to next section
   for (j=(y/8); j < (y+b)/8; j++) {
-    glcdSetAddress(x, j);
-    for (i=0; i<a; i++) {
-      if (color == ON)
-	glcdDataWrite(0xFF);
-      else
-	glcdDataWrite(0x00);
-    }
+    glcdSetRamAddress(x, j);
+    if (color == ON)
+      glcdDataFill(0xFF, a);
+    else
+      glcdDataFill(0x00, a);
   }
   b = b%8;
   // do remainder
   if (b) {
     for (i=0; i<a; i++) {
-      glcdSetAddress(x+i, j);
+      glcdSetRamAddress(x+i, j);
       temp = glcdDataRead();	// dummy read
       temp = glcdDataRead();	// read back current value
       // not on a perfect boundary
@@ -223,11 +430,11 @@ void glcdFillRectangle(u08 x, u08 y, u08 a, u08 b, u08 color)
 	else
 	  temp &= ~_BV(k);
       }
-      glcdSetAddress(x+i, j);
+      glcdSetRamAddress(x+i, j);
       glcdDataWrite(temp);
     }
   }
-  glcdStartLine(0);
+#endif
 }
 
 
@@ -261,27 +468,137 @@ void glcdCircle(u08 xcenter, u08 ycenter, u08 radius, u08 color)
   }
 }
 
+// combine bitmap byte <src> into display ram byte <x,page>, only the bits in <mask>
+static void glcdBlitByte(u08 x, u08 page, u08 src, u08 mask, u08 mode)
+{
+  u08 temp;
+
+#ifdef GLCD_SHADOW_BUFFER
+  temp = GrLcdBuffer[page][x];
+#else
+  glcdSetRamAddress(x, page);
+  temp = glcdDataRead();	// dummy read
+  temp = glcdDataRead();	// read back current value
+#endif
+  switch (mode) {
+  case GLCD_BLIT_OR:
+    temp |= src & mask;
+    break;
+  case GLCD_BLIT_AND:
+    temp &= src | ~mask;
+    break;
+  case GLCD_BLIT_XOR:
+    temp ^= src & mask;
+    break;
+  default:
+    temp = (temp & ~mask) | (src & mask);
+    break;
+  }
+#ifdef GLCD_SHADOW_BUFFER
+  GrLcdBuffer[page][x] = temp;
+#else
+  glcdSetRamAddress(x, page);
+  glcdDataWrite(temp);
+#endif
+}
+
+// draw bitmap
+void glcdBlit(u08 x, u08 y, u08 w, u08 h, const u08 *bitmap_P, u08 mode)
+{
+  glcdBlitFrom(x, y, w, h, bitmap_P, 0, mode, GLCD_BURST_PROGMEM);
+}
+
+// draw bitmap through a mask
+void glcdBlitMasked(u08 x, u08 y, u08 w, u08 h, const u08 *bitmap_P, const u08 *mask_P, u08 mode)
+{
+  glcdBlitFrom(x, y, w, h, bitmap_P, mask_P, mode, GLCD_BURST_PROGMEM);
+}
+
+// draw bitmap from RAM
+void glcdBlitRam(u08 x, u08 y, u08 w, u08 h, const u08 *bitmap, u08 mode)
+{
+  glcdBlitFrom(x, y, w, h, bitmap, 0, mode, GLCD_BURST_RAM);
+}
+
+// <bitmap> is in program memory or RAM as <from> says, <mask_P> always in program memory
+static void glcdBlitFrom(u08 x, u08 y, u08 w, u08 h, const u08 *bitmap, const u08 *mask_P, u08 mode, u08 from)
+{
+  u08 i, row, rows, cols;
+  u08 r, shift, page, nextpage;
+  u08 src, mask, rowmask;
+  u16 idx;
+
+  if ((x >= GLCD_XPIXELS) || (y >= GLCD_YPIXELS) || !w || !h)
+    return;
+  rows = (h+7)/8;
+  // clip, the source keeps its own width though
+  cols = w;
+  if (cols > GLCD_XPIXELS - x)
+    cols = GLCD_XPIXELS - x;
+  if (h > GLCD_YPIXELS - y)
+    h = GLCD_YPIXELS - y;
+
+  for (row = 0; (row < rows) && (h > row*8); row++) {
+    // bits of this source row that are inside the bitmap (and the display)
+    if (h - row*8 < 8)
+      rowmask = 0xFF >> (8 - (h - row*8));
+    else
+      rowmask = 0xFF;
+
+    // each source byte straddles two display ram pages unless aligned
+    r = glcdRamLine(y + row*8);
+    shift = r%8;
+    page = r/8;
+    nextpage = (page+1) & (GLCD_NUM_PAGES-1);
+
+    idx = (u16)row*w;
+    for (i = 0; i < cols; i++, idx++) {
+      if (from == GLCD_BURST_PROGMEM)
+	src = pgm_read_byte(bitmap + idx);
+      else
+	src = bitmap[idx];
+      mask = rowmask;
+      if (mask_P)
+	mask &= pgm_read_byte(mask_P + idx);
+      if (!mask)
+	continue;
+      if ((u08)(mask << shift))
+	glcdBlitByte(x+i, page, src << shift, mask << shift, mode);
+      if (shift && (u08)(mask >> (8-shift)))
+	glcdBlitByte(x+i, nextpage, src >> (8-shift), mask >> (8-shift), mode);
+    }
+#ifdef GLCD_SHADOW_BUFFER
+    glcdBufferDirty(page, x, x+cols-1);
+    if (shift)
+      glcdBufferDirty(nextpage, x, x+cols-1);
+#endif
+  }
+}
+
 // text routines
 
 // write a character at the current position
 void glcdWriteChar(unsigned char c, uint8_t inverted)
 {
 	u08 i = 0;
+	u08 col[6];
 
+	// five font columns and a spacer line, sent as one burst
 	for(i=0; i<5; i++)
 	{
 	  if (inverted) {
-	    glcdDataWrite(~ pgm_read_byte(&Font5x7[((c - 0x20) * 5) + i]));
+	    col[i] = ~ pgm_read_byte(&Font5x7[((c - 0x20) * 5) + i]);
 	  } else {
-	    glcdDataWrite(pgm_read_byte(&Font5x7[((c - 0x20) * 5) + i]));
+	    col[i] = pgm_read_byte(&Font5x7[((c - 0x20) * 5) + i]);
 	  }
 	}
 
 	// write a spacer line
 	if (inverted) 
-	  glcdDataWrite(0xFF);
+	  col[5] = 0xFF;
 	else 
-	  glcdDataWrite(0x00);
+	  col[5] = 0x00;
+	glcdDataWriteBurst(col, 6);
 	// unless we're at the end of the display
 	//if(xx == 128)
 	//	xx = 0;
@@ -290,7 +607,6 @@ void glcdWriteChar(unsigned char c, uint8_t inverted)
 
 	//cbi(GLCD_Control, GLCD_CS1);
 	//cbi(GLCD_Control, GLCD_CS2);
-	glcdStartLine(0);
 }
 
 void glcdWriteCharGr(u08 grCharIdx)
@@ -326,3 +642,12 @@ void glcdPutStr(char *data, uint8_t inverted)
     data++;
   }
 }
+
+// same as glcdPutStr, but the string is in program memory
+void glcdPutStr_P(const char *data_P, uint8_t inverted)
+{
+  char c;
+
+  while ((c = pgm_read_byte(data_P++)))
+    glcdWriteChar(c, inverted);
+}
@@ -59,6 +59,12 @@
 #define INVERTED 1
 #define NORMAL 0
 
+// how glcdBlit() combines the bitmap with what is on the display
+#define GLCD_BLIT_COPY		0
+#define GLCD_BLIT_OR		1
+#define GLCD_BLIT_AND		2
+#define GLCD_BLIT_XOR		3
+
 // API-level interface commands
 // ***** Public Functions *****
 
@@ -68,8 +74,14 @@ void glcdSetDot(u08 x, u08 y);
 //! clear a dot on the display (x is horiz 0:127, y is vert 0:63)
 void glcdClearDot(u08 x, u08 y);
 
-//! draw line
-void glcdLine(u08 x1, u08 y1, u08 x2, u08 y2);
+//! draw line from <x1,y1> to <x2,y2>
+void glcdLine(u08 x1, u08 y1, u08 x2, u08 y2, u08 color);
+
+//! draw horizontal line of <w> pixels starting at <x,y>
+void glcdHLine(u08 x, u08 y, u08 w, u08 color);
+
+//! draw vertical line of <h> pixels starting at <x,y>
+void glcdVLine(u08 x, u08 y, u08 h, u08 color);
 
 //! draw rectangle (coords????)
 void glcdRectangle(u08 x, u08 y, u08 a, u08 b);
@@ -79,6 +91,18 @@ void glcdFillRectangle(u08 x, u08 y, u08 a, u08 b, u08 color);
 //! draw circle of <radius> at <xcenter,ycenter>
 void glcdCircle(u08 xcenter, u08 ycenter, u08 radius, u08 color);
 
+//! draw a <w> x <h> bitmap from program memory at <x,y> (any y)
+// the bitmap is stored like display memory: (h+7)/8 rows of w column
+// bytes, bit 0 at the top; <mode> is one of GLCD_BLIT_*
+void glcdBlit(u08 x, u08 y, u08 w, u08 h, const u08 *bitmap_P, u08 mode);
+
+//! same as glcdBlit, but only pixels set in <mask_P> (laid out like
+// the bitmap) are touched
+void glcdBlitMasked(u08 x, u08 y, u08 w, u08 h, const u08 *bitmap_P, const u08 *mask_P, u08 mode);
+
+//! same as glcdBlit, but the bitmap is in RAM
+void glcdBlitRam(u08 x, u08 y, u08 w, u08 h, const u08 *bitmap, u08 mode);
+
 //! write a standard ascii charater (values 20-127)
 // to the display at current position
 void glcdWriteChar(unsigned char c, uint8_t inverted);
@@ -89,6 +113,7 @@ void glcdWriteCharGr(u08 grCharIndex);
 
 // ***** Private Functions ***** (or depricated)
 void glcdPutStr(char *data, uint8_t inverted);
+void glcdPutStr_P(const char *data_P, uint8_t inverted);
 
 
 #endif
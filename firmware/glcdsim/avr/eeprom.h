@@ -0,0 +1,10 @@
+/* host stand-in for <avr/eeprom.h> */
+#ifndef SIM_AVR_EEPROM_H
+#define SIM_AVR_EEPROM_H
+
+#include <stdint.h>
+
+#define eeprom_read_byte(p)		((uint8_t)0)
+#define eeprom_write_byte(p, v)	((void)0)
+
+#endif
@@ -0,0 +1,14 @@
+/* host stand-in for <avr/interrupt.h> */
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#include "ks0108sim.h"
+
+// interrupts never fire by themselves on the host, the caller runs
+// an interrupt handler by calling it (e.g. TIMER0_COMPB_vect())
+#define cli()	do { ks0108simSync(); simSREG &= ~0x80; } while(0)
+#define sei()	do { ks0108simSync(); simSREG |= 0x80; } while(0)
+#define SIGNAL(vector)	void vector(void)
+#define ISR(vector)		void vector(void)
+
+#endif
@@ -0,0 +1,51 @@
+/* host stand-in for <avr/io.h>, the registers live in the KS0108 and TWI models */
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+#include "ks0108sim.h"
+#include "i2csim.h"
+
+#define _BV(bit)	(1 << (bit))
+
+#define PORTB	(*ks0108simReg(&simPORTB))
+#define PORTC	(*ks0108simReg(&simPORTC))
+#define PORTD	(*ks0108simReg(&simPORTD))
+#define DDRB	(*ks0108simReg(&simDDRB))
+#define DDRC	(*ks0108simReg(&simDDRC))
+#define DDRD	(*ks0108simReg(&simDDRD))
+#define PINB	(*ks0108simReg(&simPINB))
+#define PINC	(*ks0108simReg(&simPINC))
+#define PIND	(*ks0108simReg(&simPIND))
+#define SREG	simSREG
+#define TIMSK0	simTIMSK0
+#define OCR0B	simOCR0B
+#define OCIE0B	2
+#define TCCR1B	simTCCR1B
+#define TCNT1	simTCNT1
+#define CS10	0
+#define PCICR	simPCICR
+#define PCMSK1	simPCMSK1
+#define PCIE1	1
+
+#define TWCR	simTWCR
+#define TWSR	simTWSR
+#define TWDR	simTWDR
+#define TWBR	simTWBR
+#define TWAR	simTWAR
+#define TWINT	7
+#define TWEA	6
+#define TWSTA	5
+#define TWSTO	4
+#define TWWC	3
+#define TWEN	2
+#define TWIE	0
+
+// the TWI model acts on what is written to TWCR (only i2c.c uses outb())
+#undef outb
+#define outb(addr, data)	i2csimOut(&(addr), (data))
+
+// cycle counted delays take no time on the host
+#define __builtin_avr_delay_cycles(n)	((void)0)
+
+#endif
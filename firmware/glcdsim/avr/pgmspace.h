@@ -0,0 +1,13 @@
+/* host stand-in for <avr/pgmspace.h>, program memory is just memory */
+#ifndef SIM_AVR_PGMSPACE_H
+#define SIM_AVR_PGMSPACE_H
+
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)				(s)
+#define pgm_read_byte(p)	(*(const unsigned char *)(p))
+#define pgm_read_word(p)	(*(const unsigned short *)(p))
+#define memcpy_P			memcpy
+
+#endif
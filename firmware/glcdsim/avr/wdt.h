@@ -0,0 +1,8 @@
+/* host stand-in for <avr/wdt.h> */
+#ifndef SIM_AVR_WDT_H
+#define SIM_AVR_WDT_H
+
+#define wdt_reset()		((void)0)
+#define wdt_enable(t)	((void)0)
+
+#endif
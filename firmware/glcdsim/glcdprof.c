@@ -0,0 +1,199 @@
+/* ***************************************************************************
+// glcdprof.c - run the display code on the host against the KS0108 model
+// This code is distributed under the GNU Public License
+//		which can be found at http://www.gnu.org/licenses/gpl.txt
+//
+// Builds glcd.c, ks0108.c and anim.c for the host (see the Makefile here),
+// runs a few typical drawing operations and prints how many bus cycles of
+// each kind every one of them took, including the glcdFlush() that sends
+// it out.  After each operation the panel is written to <name>.pbm in the
+// directory given on the command line (default: the current one), and
+// checked against golden/<name>.pbm: any difference fails the operation
+// and glcdprof exits with 1.  Run it from this directory.
+//
+//   make && ./glcdprof /tmp
+//   ./glcdprof -b 3 /tmp	(panel stays busy for 3 status reads per write)
+//   ./glcdprof -g		(after a change that is meant to show: new golden images)
+**************************************************************************** */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "ks0108sim.h"
+#include "../ratt.h"
+#include "../ks0108.h"
+#include "../glcd.h"
+
+// what anim.c expects ratt.c to provide
+volatile uint8_t alarming, alarm_h, alarm_m;
+volatile uint8_t time_format = TIME_24H;
+volatile uint8_t region;
+volatile uint8_t score_mode;
+volatile uint8_t baseInverted;
+volatile uint8_t minute_changed, hour_changed;
+volatile uint8_t rtc_lost;
+
+// and what util.c would
+void ROM_putstring(const char *str, uint8_t nl)
+{
+	fputs(str, stdout);
+	if(nl)
+		fputs("\n", stdout);
+}
+
+void uart_putw_dec(uint16_t w)
+{
+	printf("%u", w);
+}
+
+// and rtc.c
+static datetime_t now;
+
+void get_time_snapshot(datetime_t *t)
+{
+	*t = now;
+}
+
+extern datetime_t shown_time;
+
+// and sched.c
+void sched_ready(uint8_t task)
+{
+}
+
+static const char *outdir = ".";
+static const char *goldendir = "golden";
+
+static void opClear(void)
+{
+	glcdClearScreen();
+}
+
+static void opFill(void)
+{
+	glcdFillRectangle(0, 0, GLCD_XPIXELS, GLCD_YPIXELS, ON);
+}
+
+static void opRect(void)
+{
+	glcdFillRectangle(13, 5, 70, 30, ON);
+}
+
+static void opText(void)
+{
+	glcdSetAddress(0, 3);
+	glcdPutStr("The quick brown fox", NORMAL);
+}
+
+static void opLine(void)
+{
+	glcdLine(0, 0, GLCD_XPIXELS-1, GLCD_YPIXELS-1, ON);
+	glcdLine(0, GLCD_YPIXELS-1, GLCD_XPIXELS-1, 0, ON);
+	// uneven slopes, shallow and steep, both ways: the ones above
+	// come out even and would miss a bresenham that overshoots
+	glcdLine(0, 0, 3, 2, ON);
+	glcdLine(10, 0, 16, 4, ON);
+	glcdLine(20, 0, 29, 5, ON);
+	glcdLine(40, 10, 47, 61, ON);
+	glcdLine(90, 60, 60, 20, ON);
+	glcdLine(127, 30, 100, 41, ON);
+}
+
+static void opScroll(void)
+{
+	glcdScrollBy(8);
+}
+
+static void opInitDisplay(void)
+{
+	initdisplay(NORMAL);
+}
+
+static void opDraw(void)
+{
+	// one minute on, only the last digit changes
+	shown_time.m = bcd_inc(shown_time.m);
+	draw(NORMAL);
+}
+
+struct profop
+{
+	const char *name;
+	void (*prepare)(void);	// not counted
+	void (*run)(void);
+};
+
+static const struct profop ops[] =
+{
+	{ "clear",			0,			opClear },
+	{ "fill",			opClear,	opFill },
+	{ "fillrect",		opClear,	opRect },
+	{ "text",			opClear,	opText },
+	{ "line",			opClear,	opLine },
+	{ "scroll",			0,			opScroll },
+	{ "initdisplay",	opClear,	opInitDisplay },
+	{ "draw",			0,			opDraw },
+};
+
+int main(int argc, char **argv)
+{
+	unsigned char i, golden = 0;
+	int diff, failed = 0;
+	char filename[256];
+	ks0108simCounts *n = &ks0108simCount;
+
+	for(i=1; i<argc; i++)
+	{
+		if(!strcmp(argv[i], "-b") && (i+1 < argc))
+			ks0108simBusyReads = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-g"))
+			golden = 1;
+		else
+			outdir = argv[i];
+	}
+
+	now.h = 0x12;
+	now.m = 0x34;
+	initanim();
+
+	ks0108simReset();
+	glcdInit();
+	ks0108simSync();
+	printf("%-12s %6s %6s %6s %6s %6s\n", "operation", "ctrl", "write", "read", "busy", "total");
+	printf("%-12s %6lu %6lu %6lu %6lu %6lu\n", "init", n->ctrlWrites, n->dataWrites,
+		n->dataReads, n->statusReads, n->ctrlWrites + n->dataWrites + n->dataReads + n->statusReads);
+
+	for(i=0; i<sizeof(ops)/sizeof(ops[0]); i++)
+	{
+		if(ops[i].prepare)
+		{
+			ops[i].prepare();
+			glcdFlush();
+		}
+		ks0108simSync();
+		ks0108simClearCounts();
+		ops[i].run();
+		glcdFlush();
+		ks0108simSync();
+
+		printf("%-12s %6lu %6lu %6lu %6lu %6lu\n", ops[i].name, n->ctrlWrites, n->dataWrites,
+			n->dataReads, n->statusReads, n->ctrlWrites + n->dataWrites + n->dataReads + n->statusReads);
+		snprintf(filename, sizeof(filename), "%s/%s.pbm", golden ? goldendir : outdir, ops[i].name);
+		if(ks0108simWritePBM(filename))
+			fprintf(stderr, "can't write %s\n", filename);
+		if(golden)
+			continue;
+
+		snprintf(filename, sizeof(filename), "%s/%s.pbm", goldendir, ops[i].name);
+		diff = ks0108simComparePBM(filename);
+		if(diff < 0)
+			printf("%-12s FAILED, can't read %s\n", ops[i].name, filename);
+		else if(diff)
+			printf("%-12s FAILED, %d pixels differ from %s\n", ops[i].name, diff, filename);
+		if(diff)
+			failed = 1;
+	}
+	return failed;
+}
@@ -0,0 +1,262 @@
+/* ***************************************************************************
+// i2cfault.c - run the RTC code on the host against a faulty i2c bus
+// This code is distributed under the GNU Public License
+//		which can be found at http://www.gnu.org/licenses/gpl.txt
+//
+// Builds i2c.c and rtc.c for the host (see the Makefile here) against the
+// TWI and DS1307 model in i2csim.c, injects each kind of fault the model
+// knows and checks that the clock gets through it.  Prints a line per
+// case and exits with 1 if any of them failed.
+//
+//   make i2cfault && ./i2cfault
+**************************************************************************** */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <avr/io.h>
+#include "ks0108sim.h"
+#include "i2csim.h"
+#include "../ratt.h"
+#include "../i2c.h"
+
+// timer0 interrupts per second, as rtc.c counts them
+#define TIMER0_HZ	(F_CPU / 64 / 126)
+
+extern volatile datetime_t rtc_time;
+extern volatile uint8_t rtc_seq;
+extern volatile uint8_t rtc_lost;
+#ifdef RTC_SQW
+extern volatile uint8_t sqw_alive;
+void SQW_vect(void);
+#endif
+
+// and util.c
+void ROM_putstring(const char *str, uint8_t nl)
+{
+}
+
+void uart_putw_dec(uint16_t w)
+{
+}
+
+// and sched.c
+static uint8_t ready;
+
+void sched_ready(uint8_t task)
+{
+	ready |= 1 << task;
+}
+
+// and event.c
+static int ticks;
+
+uint8_t event_put(uint8_t type, uint8_t data)
+{
+	if(type == EVENT_TICK)
+		ticks++;
+	return 1;
+}
+
+static int failed;
+
+static void check(const char *name, int ok)
+{
+	printf("%-28s %s\n", name, ok ? "ok" : "FAILED");
+	if(!ok)
+		failed = 1;
+}
+
+static unsigned char bcd(unsigned char x)
+{
+	return ((x/10) << 4) | (x%10);
+}
+
+// what the RTC counts, in its registers
+static void setRtc(unsigned char h, unsigned char m, unsigned char s,
+	unsigned char d, unsigned char mo, unsigned char y)
+{
+	i2csimRtc[0] = bcd(s);
+	i2csimRtc[1] = bcd(m);
+	i2csimRtc[2] = bcd(h);
+	i2csimRtc[4] = bcd(d);
+	i2csimRtc[5] = bcd(mo);
+	i2csimRtc[6] = bcd(y);
+}
+
+// the time rtc.c keeps is BCD too
+static void setTime(unsigned char h, unsigned char m, unsigned char s,
+	unsigned char d, unsigned char mo, unsigned char y)
+{
+	datetime_t t = { bcd(s), bcd(m), bcd(h), bcd(d), bcd(mo), bcd(y) };
+
+	rtc_time = t;
+}
+
+static int timeIs(unsigned char h, unsigned char m, unsigned char s,
+	unsigned char d, unsigned char mo, unsigned char y)
+{
+	datetime_t t;
+
+	get_time_snapshot(&t);
+	return t.h == bcd(h) && t.m == bcd(m) && t.s == bcd(s) &&
+		t.d == bcd(d) && t.mo == bcd(mo) && t.y == bcd(y);
+}
+
+// n clock_poll()s, with the TWI interrupt doing its work in between
+static void poll(int n)
+{
+	while(n--)
+	{
+		rtc_poll();
+		i2csimRun();
+	}
+}
+
+// timer0 ms until the second changes (0 if it doesn't within 2 s)
+static int msToNextSecond(void)
+{
+	unsigned char s = rtc_time.s;
+	int ms;
+
+	for(ms=1; ms<=2*TIMER0_HZ; ms++)
+	{
+		rtc_ms();
+		if(rtc_time.s != s)
+			return ms;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	unsigned long clocks;
+
+	ks0108simReset();
+	i2csimReset();
+
+	setRtc(12, 34, 56, 14, 3, 9);
+	rtc_init();
+	check("startup read", timeIs(12, 34, 56, 14, 3, 9) && !rtc_lost);
+#ifdef RTC_SQW
+	check("square wave switched on", i2csimRtc[7] == 0x10);
+#endif
+
+	i2csimRtc[0] |= 0x80;
+	rtc_init();
+	check("halted clock is reset", timeIs(12, 0, 0, 1, 1, 9) && i2csimRtc[0] == 0);
+
+	setRtc(1, 2, 3, 4, 5, 6);
+	i2csimNack = 1;
+	readi2ctime();
+	check("nack is retried", timeIs(1, 2, 3, 4, 5, 6) && !rtc_lost);
+
+	setRtc(2, 3, 4, 5, 6, 7);
+	i2csimHang = 3;
+	readi2ctime();
+	check("hang times out, retried", timeIs(2, 3, 4, 5, 6, 7) && i2csimCount.resets == 1);
+
+	setRtc(3, 4, 5, 6, 7, 8);
+	clocks = i2csimCount.clocks;
+	i2csimSdaStuck = 5;
+	readi2ctime();
+	check("stuck sda clocked free", timeIs(3, 4, 5, 6, 7, 8) && !i2csimSdaStuck &&
+		i2csimCount.clocks - clocks >= 5 && i2csimCount.clocks - clocks <= 10);
+
+	setRtc(4, 5, 6, 7, 8, 9);
+	check("background read starts", rtc_read_start() == I2C_OK);
+	check("busy while it runs", rtc_read_start() == I2C_ERROR_BUSY);
+	i2csimRun();
+	check("background read", timeIs(4, 5, 6, 7, 8, 9) && i2cGetState() == I2C_IDLE);
+
+	setRtc(4, 5, 7, 7, 8, 9);
+	rtc_read_start();
+	ready = 0;
+	task_rtc();
+	check("resync waits for the read", !ready);
+	i2csimRun();
+	check("and goes once it is in", (ready == (1 << TASK_RTC)) && i2cGetState() == I2C_IDLE);
+	ready = 0;
+	task_rtc();
+	i2csimRun();
+	check("resync read", !ready && timeIs(4, 5, 7, 7, 8, 9));
+
+	setRtc(5, 6, 7, 8, 9, 10);
+	i2csimHang = 2;
+	rtc_read_start();
+	i2csimRun();
+	check("background hang stays busy", i2cGetState() != I2C_IDLE);
+	poll(4);
+	check("background hang aborted", timeIs(5, 6, 7, 8, 9, 10) &&
+		i2cGetState() == I2C_IDLE && !rtc_lost);
+
+	setRtc(6, 7, 8, 9, 10, 11);
+	i2csimHang = 2;
+	rtc_read_start();
+	i2csimRun();
+	{
+		datetime_t t = { 0x30, 0x20, 0x10, 0x01, 0x02, 0x03 };
+
+		rtc_set(&t);
+	}
+	check("set during a hung read", timeIs(10, 20, 30, 1, 2, 3) &&
+		i2csimRtc[0] == 0x30 && i2csimRtc[2] == 0x10 && i2cGetState() == I2C_IDLE);
+
+	i2csimAbsent = 1;
+	poll(3);
+	check("rtc gone", rtc_lost);
+	writei2ctime(0x06, 0x07, 0x08, 0, 0x09, 0x10, 0x11);
+	check("write to a gone rtc returns", rtc_lost);
+
+	setTime(23, 59, 59, 28, 2, 12);
+	ticks = 0;
+	check("timer0 keeps the seconds", msToNextSecond() == TIMER0_HZ);
+	check("the second is queued", ticks == 1);
+	check("leap day", timeIs(0, 0, 0, 29, 2, 12));
+	setTime(23, 59, 59, 29, 2, 12);
+	tick();
+	check("after the leap day", timeIs(0, 0, 0, 1, 3, 12));
+	setTime(23, 59, 59, 28, 2, 13);
+	tick();
+	check("no leap day", timeIs(0, 0, 0, 1, 3, 13));
+	setTime(23, 59, 59, 30, 4, 13);
+	tick();
+	check("30 day month", timeIs(0, 0, 0, 1, 5, 13));
+	setTime(23, 59, 59, 31, 12, 99);
+	tick();
+	check("new century", timeIs(0, 0, 0, 1, 1, 0));
+
+	i2csimAbsent = 0;
+	setRtc(7, 8, 9, 10, 11, 12);
+	ticks = 0;
+	poll(70);
+	check("a new second read is queued", ticks == 1);
+	check("rtc back", timeIs(7, 8, 9, 10, 11, 12) && !rtc_lost);
+	check("timer0 leaves it alone", msToNextSecond() == 0);
+
+#ifdef RTC_SQW
+	// falling edges on the square wave pin
+	setTime(8, 9, 59, 11, 12, 13);
+	setRtc(8, 9, 59, 11, 12, 13);
+	ready = 0;
+	simPORTC &= ~BV(SQW);
+	SQW_vect();
+	check("first edge asks for a read", sqw_alive && (ready & (1 << TASK_RTC)) &&
+		timeIs(8, 9, 59, 11, 12, 13));
+	ready = 0;
+	SQW_vect();
+	check("edges count the seconds", timeIs(8, 10, 0, 11, 12, 13));
+	check("resync once a minute", ready & (1 << TASK_RTC));
+	simPORTC |= BV(SQW);
+	SQW_vect();
+	check("rising edge does nothing", timeIs(8, 10, 0, 11, 12, 13));
+
+	setRtc(9, 10, 11, 12, 1, 14);
+	poll(1);
+	check("no reads while it runs", timeIs(8, 10, 0, 11, 12, 13));
+	poll(SQW_TIMEOUT+1);
+	check("square wave stopped", timeIs(9, 10, 11, 12, 1, 14) && !sqw_alive);
+#endif
+
+	return failed;
+}
@@ -0,0 +1,172 @@
+/* ***************************************************************************
+// i2csim.c - software model of the TWI and the DS1307 for host builds
+// This code is distributed under the GNU Public License
+//		which can be found at http://www.gnu.org/licenses/gpl.txt
+//
+// A bus step (start, address, data byte) finishes the moment it is
+// written to TWCR.  A stop finishes at once too, without setting TWINT,
+// like the real TWI.  The pins come from i2cconf.h.
+**************************************************************************** */
+
+#include <string.h>
+
+#include <avr/io.h>
+#include "i2csim.h"
+#include "ks0108sim.h"
+#include "../i2c.h"
+
+unsigned char i2csimRtc[64];
+unsigned char i2csimAbsent, i2csimNack, i2csimHang, i2csimSdaStuck;
+i2csimCounts i2csimCount;
+
+unsigned char simTWCR, simTWSR, simTWDR, simTWBR, simTWAR;
+
+// where the transfer is at
+enum { BUS_IDLE, BUS_ADDRESS, BUS_WRITE, BUS_READ, BUS_NACKED };
+static unsigned char phase;
+// the first byte written sets the register pointer
+static unsigned char pointerNext;
+static unsigned char pointer;
+// a step never finished, the TWI does nothing until it is switched off
+static unsigned char hung;
+// SCL as it was the last time we looked
+static unsigned char lastScl;
+
+extern void TWI_vect(void);
+
+void i2csimReset(void)
+{
+	i2csimAbsent = i2csimNack = i2csimHang = i2csimSdaStuck = 0;
+	memset(&i2csimCount, 0, sizeof(i2csimCount));
+	simTWCR = simTWSR = simTWDR = 0;
+	phase = BUS_IDLE;
+	hung = 0;
+	lastScl = 0;
+	ks0108simPinC = i2csimPinC;
+}
+
+// the address went out, does the RTC answer?
+static unsigned char addressed(void)
+{
+	if((simTWDR & 0xFE) != 0xD0 || i2csimAbsent)
+		return 0;
+	if(i2csimNack)
+	{
+		i2csimNack--;
+		return 0;
+	}
+	return 1;
+}
+
+void i2csimOut(unsigned char *reg, unsigned char data)
+{
+	unsigned char read;
+
+	*reg = data;
+	if(reg != &simTWCR)
+		return;
+
+	if(!(data & BV(TWEN)))
+	{
+		// switched off, which gets a stuck TWI going again
+		if(phase != BUS_IDLE || hung)
+			i2csimCount.resets++;
+		phase = BUS_IDLE;
+		hung = 0;
+		return;
+	}
+	// writing TWINT starts the next step, without it only the enables change
+	if(!(data & BV(TWINT)))
+		return;
+	simTWCR = data & ~(BV(TWINT)|BV(TWSTO));
+	if(hung)
+		return;
+
+	if(data & BV(TWSTO))
+	{
+		phase = BUS_IDLE;
+		if(!(data & BV(TWSTA)))
+			return;
+	}
+
+	if(i2csimHang && !--i2csimHang)
+	{
+		hung = 1;
+		return;
+	}
+
+	if(data & BV(TWSTA))
+	{
+		// a start needs SDA high
+		if(i2csimSdaStuck)
+		{
+			hung = 1;
+			return;
+		}
+		i2csimCount.starts++;
+		simTWSR = (phase == BUS_IDLE) ? TW_START : TW_REP_START;
+		phase = BUS_ADDRESS;
+	}
+	else if(phase == BUS_ADDRESS)
+	{
+		read = simTWDR & 0x01;
+		if(addressed())
+		{
+			simTWSR = read ? TW_MR_SLA_ACK : TW_MT_SLA_ACK;
+			phase = read ? BUS_READ : BUS_WRITE;
+			pointerNext = 1;
+		}
+		else
+		{
+			simTWSR = read ? TW_MR_SLA_NACK : TW_MT_SLA_NACK;
+			phase = BUS_NACKED;
+		}
+	}
+	else if(phase == BUS_WRITE)
+	{
+		if(pointerNext)
+			pointer = simTWDR & 63;
+		else
+		{
+			i2csimRtc[pointer] = simTWDR;
+			pointer = (pointer+1) & 63;
+		}
+		pointerNext = 0;
+		simTWSR = TW_MT_DATA_ACK;
+	}
+	else if(phase == BUS_READ)
+	{
+		simTWDR = i2csimRtc[pointer];
+		pointer = (pointer+1) & 63;
+		simTWSR = (data & BV(TWEA)) ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+	}
+	else
+	{
+		// nothing going on the bus, nothing to finish
+		return;
+	}
+	simTWCR |= BV(TWINT);
+}
+
+void i2csimRun(void)
+{
+	while((simTWCR & BV(TWEN)) && (simTWCR & BV(TWIE)) && (simTWCR & BV(TWINT)))
+		TWI_vect();
+}
+
+unsigned char i2csimPinC(unsigned char pins)
+{
+	unsigned char scl = (pins >> I2C_SCL) & 1;
+
+	// clocked by hand (i2cBusRecover), the slave shifts out a bit
+	if(lastScl && !scl)
+	{
+		i2csimCount.clocks++;
+		if(i2csimSdaStuck)
+			i2csimSdaStuck--;
+	}
+	lastScl = scl;
+	if(i2csimSdaStuck)
+		pins &= ~BV(I2C_SDA);
+	return pins;
+}
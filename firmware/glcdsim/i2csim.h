@@ -0,0 +1,47 @@
+/* ***************************************************************************
+// i2csim.h - software model of the TWI and the DS1307 for host builds
+// This code is distributed under the GNU Public License
+//		which can be found at http://www.gnu.org/licenses/gpl.txt
+//
+// The TWI registers are plain variables here.  outb() goes through
+// i2csimOut(), so every command written to TWCR is carried out at once
+// against a DS1307 at address 0xD0, and TWINT is set when it is done.
+// The faults below make the model misbehave the ways a real bus does.
+**************************************************************************** */
+
+#ifndef I2CSIM_H
+#define I2CSIM_H
+
+// the DS1307's registers: time and date, control, battery backed ram
+extern unsigned char i2csimRtc[64];
+
+// faults to inject, they count down as they happen
+extern unsigned char i2csimAbsent;		// while set the RTC doesn't ACK its address
+extern unsigned char i2csimNack;		// NACK the next n address phases
+extern unsigned char i2csimHang;		// the n-th bus step from now never finishes
+										// (until the TWI is switched off)
+extern unsigned char i2csimSdaStuck;	// a slave holds SDA low for n more SCL clocks
+
+// what the driver did since i2csimReset()
+typedef struct
+{
+	unsigned long starts;		// start conditions that went out
+	unsigned long resets;		// times the TWI was switched off
+	unsigned long clocks;		// SCL clocks made by hand
+} i2csimCounts;
+
+extern i2csimCounts i2csimCount;
+
+// the TWI registers
+extern unsigned char simTWCR, simTWSR, simTWDR, simTWBR, simTWAR;
+
+//! Bus idle, TWI off, no faults, counters zero (the RTC registers stay)
+void i2csimReset(void);
+//! outb() on the host: write the register, act on TWCR commands
+void i2csimOut(unsigned char *reg, unsigned char data);
+//! Call the TWI interrupt for as long as it has something to do
+void i2csimRun(void);
+//! What the port C pins read with the bus attached (hooked into ks0108simSync)
+unsigned char i2csimPinC(unsigned char pins);
+
+#endif
@@ -0,0 +1,222 @@
+/* ***************************************************************************
+// ks0108sim.c - software model of the KS0108 panel for host builds
+// This code is distributed under the GNU Public License
+//		which can be found at http://www.gnu.org/licenses/gpl.txt
+//
+// Wired like the clock: RS, RW, E and the low data nibble on port B,
+// CS0 on port C, CS1 and the high data nibble on port D.  The bit
+// numbers come from ks0108conf.h.
+**************************************************************************** */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ks0108sim.h"
+#include "../ks0108conf.h"
+
+// KS0108 commands, as in ks0108.h
+#define SIM_ON_CTRL		0x3E
+#define SIM_START_LINE	0xC0
+#define SIM_SET_PAGE	0xB8
+#define SIM_SET_Y_ADDR	0x40
+#define SIM_STATUS_BUSY	0x80
+#define SIM_STATUS_OFF	0x20
+
+ks0108simCtrlr ks0108simCtrl[KS0108SIM_CONTROLLERS];
+ks0108simCounts ks0108simCount;
+unsigned char ks0108simBusyReads = 0;
+
+unsigned char simPORTB, simPORTC, simPORTD;
+unsigned char simDDRB, simDDRC, simDDRD;
+unsigned char simPINB, simPINC, simPIND;
+unsigned char simSREG, simTIMSK0, simOCR0B;
+unsigned char simTCCR1B;
+unsigned short simTCNT1;
+unsigned char simPCICR, simPCMSK1;
+
+unsigned char (*ks0108simPinC)(unsigned char pins);
+
+// E as it was the last time we looked
+static unsigned char lastE;
+
+static unsigned char selected(unsigned char c)
+{
+	if(c == 0)
+		return (simPORTC >> GLCD_CTRL_CS0) & 1;
+	return (simPORTD >> GLCD_CTRL_CS1) & 1;
+}
+
+// the byte a controller drives onto the bus while E is high for a read
+static unsigned char busOut(ks0108simCtrlr *ctrl, unsigned char rs)
+{
+	if(rs)
+		return ctrl->outLatch;
+	return (ctrl->busy ? SIM_STATUS_BUSY : 0) | (ctrl->on ? 0 : SIM_STATUS_OFF);
+}
+
+// one bus cycle, on the falling edge of E
+static void strobe(ks0108simCtrlr *ctrl, unsigned char rs, unsigned char rw, unsigned char data)
+{
+	if(rw && !rs)
+	{
+		// status read, the busy time runs out as we are polled
+		ks0108simCount.statusReads++;
+		if(ctrl->busy)
+			ctrl->busy--;
+		return;
+	}
+	if(rw)
+	{
+		// data read: the bus had the latch from the previous access,
+		// now the latch is loaded from the current address (hence the
+		// dummy read after setting the address)
+		ks0108simCount.dataReads++;
+		ctrl->outLatch = ctrl->ram[ctrl->page][ctrl->col];
+		ctrl->col = (ctrl->col+1) & 63;
+		return;
+	}
+	if(rs)
+	{
+		ks0108simCount.dataWrites++;
+		ctrl->ram[ctrl->page][ctrl->col] = data;
+		ctrl->col = (ctrl->col+1) & 63;
+	}
+	else
+	{
+		ks0108simCount.ctrlWrites++;
+		if((data & 0xFE) == SIM_ON_CTRL)
+			ctrl->on = data & 1;
+		else if((data & 0xC0) == SIM_START_LINE)
+			ctrl->startLine = data & 63;
+		else if((data & 0xF8) == SIM_SET_PAGE)
+			ctrl->page = data & 7;
+		else if((data & 0xC0) == SIM_SET_Y_ADDR)
+			ctrl->col = data & 63;
+	}
+	ctrl->busy = ks0108simBusyReads;
+}
+
+void ks0108simSync(void)
+{
+	unsigned char e, rs, rw, c;
+	unsigned char out, bus;
+
+	e = (simPORTB >> GLCD_CTRL_E) & 1;
+	rs = (simPORTB >> GLCD_CTRL_RS) & 1;
+	rw = (simPORTB >> GLCD_CTRL_RW) & 1;
+	// what the AVR drives onto the data lines
+	out = (simPORTD & 0xF0) | (simPORTB & 0x0F);
+
+	if(lastE && !e)
+	{
+		for(c=0; c<KS0108SIM_CONTROLLERS; c++)
+		{
+			if(selected(c))
+				strobe(&ks0108simCtrl[c], rs, rw, out);
+		}
+	}
+	lastE = e;
+
+	// the data lines read back what drives them: the controller during
+	// a read strobe, otherwise our own outputs or the pull-ups
+	bus = out;
+	if(e && rw)
+	{
+		for(c=0; c<KS0108SIM_CONTROLLERS; c++)
+		{
+			if(selected(c))
+				bus = busOut(&ks0108simCtrl[c], rs);
+		}
+	}
+	simPIND = (simPORTD & simDDRD) | (bus & 0xF0 & ~simDDRD) | (simPORTD & 0x0F & ~simDDRD);
+	simPINB = (simPORTB & simDDRB) | (bus & 0x0F & ~simDDRB) | (simPORTB & 0xF0 & ~simDDRB);
+	simPINC = simPORTC;
+	if(ks0108simPinC)
+		simPINC = ks0108simPinC(simPINC);
+}
+
+unsigned char *ks0108simReg(unsigned char *reg)
+{
+	ks0108simSync();
+	return reg;
+}
+
+void ks0108simReset(void)
+{
+	memset(ks0108simCtrl, 0, sizeof(ks0108simCtrl));
+	simPORTB = simPORTC = simPORTD = 0;
+	simDDRB = simDDRC = simDDRD = 0;
+	lastE = 0;
+	ks0108simSync();
+	ks0108simClearCounts();
+}
+
+void ks0108simClearCounts(void)
+{
+	memset(&ks0108simCount, 0, sizeof(ks0108simCount));
+}
+
+unsigned char ks0108simPixel(unsigned char x, unsigned char y)
+{
+	ks0108simCtrlr *ctrl = &ks0108simCtrl[(x/64) % KS0108SIM_CONTROLLERS];
+	unsigned char line = (y + ctrl->startLine) & 63;
+
+	if(!ctrl->on)
+		return 0;
+	return (ctrl->ram[line/8][x & 63] >> (line%8)) & 1;
+}
+
+int ks0108simWritePBM(const char *filename)
+{
+	FILE *f;
+	unsigned char x, y;
+
+	f = fopen(filename, "w");
+	if(!f)
+		return -1;
+	fprintf(f, "P1\n%d %d\n", 64*KS0108SIM_CONTROLLERS, 64);
+	for(y=0; y<64; y++)
+	{
+		// (plain PBM lines should stay under 70 characters)
+		for(x=0; x<64*KS0108SIM_CONTROLLERS; x++)
+		{
+			fputc(ks0108simPixel(x, y) ? '1' : '0', f);
+			if((x & 63) == 63)
+				fputc('\n', f);
+		}
+	}
+	return fclose(f);
+}
+
+int ks0108simComparePBM(const char *filename)
+{
+	FILE *f;
+	int w, h, c, x, y, diff = 0;
+
+	f = fopen(filename, "r");
+	if(!f)
+		return -1;
+	if((fscanf(f, "P1 %d %d", &w, &h) != 2) || (w != 64*KS0108SIM_CONTROLLERS) || (h != 64))
+	{
+		fclose(f);
+		return -1;
+	}
+	for(y=0; y<64; y++)
+	{
+		for(x=0; x<64*KS0108SIM_CONTROLLERS; x++)
+		{
+			do
+				c = fgetc(f);
+			while((c == ' ') || (c == '\n') || (c == '\r') || (c == '\t'));
+			if((c != '0') && (c != '1'))
+			{
+				fclose(f);
+				return -1;
+			}
+			if((c == '1') != ks0108simPixel(x, y))
+				diff++;
+		}
+	}
+	fclose(f);
+	return diff;
+}
@@ -0,0 +1,71 @@
+/* ***************************************************************************
+// ks0108sim.h - software model of the KS0108 panel for host builds
+// This code is distributed under the GNU Public License
+//		which can be found at http://www.gnu.org/licenses/gpl.txt
+//
+// The AVR port registers used by ks0108.c are plain variables here, and
+// every access to one goes through ks0108simReg(), which first lets the
+// model look at the pins.  The model acts on the falling edge of E like
+// the real controllers do, so the driver runs unchanged on top of it.
+**************************************************************************** */
+
+#ifndef KS0108SIM_H
+#define KS0108SIM_H
+
+#define KS0108SIM_CONTROLLERS	2
+
+// one HD61202/KS0108 controller, 64 columns by 8 pages
+typedef struct
+{
+	unsigned char ram[8][64];
+	unsigned char page;			// page (X address) register
+	unsigned char col;			// column (Y address) counter
+	unsigned char startLine;	// display start line
+	unsigned char on;			// display on/off
+	unsigned char outLatch;		// what the next data read puts on the bus
+	unsigned char busy;			// status reads left that still say busy
+} ks0108simCtrlr;
+
+// bus cycles (E strobes) seen since the last ks0108simClearCounts()
+typedef struct
+{
+	unsigned long ctrlWrites;
+	unsigned long dataWrites;
+	unsigned long dataReads;
+	unsigned long statusReads;	// busy polls
+} ks0108simCounts;
+
+extern ks0108simCtrlr ks0108simCtrl[KS0108SIM_CONTROLLERS];
+extern ks0108simCounts ks0108simCount;
+// how many status reads report busy after each write, to exercise the
+// busy handling of the driver (0, the default, is a panel that is never busy)
+extern unsigned char ks0108simBusyReads;
+
+// the AVR registers the driver touches
+extern unsigned char simPORTB, simPORTC, simPORTD;
+extern unsigned char simDDRB, simDDRC, simDDRD;
+extern unsigned char simPINB, simPINC, simPIND;
+extern unsigned char simSREG, simTIMSK0, simOCR0B;
+extern unsigned char simTCCR1B;
+extern unsigned short simTCNT1;
+extern unsigned char simPCICR, simPCMSK1;
+// other models on port C (the i2c bus) get to change what its pins read
+extern unsigned char (*ks0108simPinC)(unsigned char pins);
+
+//! Look at the pins, then hand back the register to be accessed
+unsigned char *ks0108simReg(unsigned char *reg);
+//! Look at the pins (catches the last edge before the driver stops touching ports)
+void ks0108simSync(void);
+//! Power-on state: display ram cleared, registers zero, display off
+void ks0108simReset(void);
+//! Zero the bus cycle counters
+void ks0108simClearCounts(void);
+//! Pixel <x,y> as the panel shows it right now (start line applied)
+unsigned char ks0108simPixel(unsigned char x, unsigned char y);
+//! Write what the panel shows as a plain (P1) PBM, returns 0 on success
+int ks0108simWritePBM(const char *filename);
+//! Compare what the panel shows against a plain PBM written by ks0108simWritePBM(),
+//! returns how many pixels differ, or -1 if the file can't be read as one
+int ks0108simComparePBM(const char *filename);
+
+#endif
@@ -17,6 +17,7 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/delay.h>
 
 #include "i2c.h"
 #include "util.h"
@@ -25,7 +26,8 @@
 // 100KHz for slow speed
 // 400KHz for high speed
 
-#define I2C_DEBUG 1
+// prints every state from the interrupt, far too slow for anything else
+//#define I2C_DEBUG 1
 
 // I2C state and address variables
 static volatile eI2cStateType I2cState;
@@ -38,6 +40,8 @@ static u08 I2cSendDataLength;
 static u08 I2cReceiveData[I2C_RECEIVE_DATA_BUFFER_SIZE];
 static u08 I2cReceiveDataIndex;
 static u08 I2cReceiveDataLength;
+// called when a master transfer is over
+static void (*i2cMasterDone)(u08 status, u08 length, u08* data);
 
 // function pointer to i2c receive routine
 //! I2cSlaveReceive is called when this processor
@@ -51,9 +55,8 @@ static u08 (*i2cSlaveTransmit)(u08 transmitDataLengthMax, u08* transmitData);
 void i2cInit(void)
 {
 	// set pull-up resistors on I2C bus pins
-	// TODO: should #ifdef these
-	sbi(PORTC, 5);	// i2c SCL on ATmegaxx8
-	sbi(PORTC, 4);	// i2c SDA on ATmegaxx8
+	sbi(I2C_PORT, I2C_SCL);
+	sbi(I2C_PORT, I2C_SDA);
 
 	// clear SlaveReceive and SlaveTransmit handler to null
 	i2cSlaveReceive = 0;
@@ -87,10 +90,9 @@ void i2cSetBitrate(u16 bitrate)
 	#endif
 	*/
 
-	// calculate bitrate division	
-	bitrate_div = (F_CPU/32)/bitrate;
-	//outb(TWBR, bitrate_div);
-	TWBR = 32;
+	// calculate bitrate division (32 for 100KHz at 8MHz)
+	bitrate_div = ((F_CPU/1000l)/bitrate - 16)/2;
+	TWBR = bitrate_div;
 }
 
 void i2cSetLocalDeviceAddr(u08 deviceAddr, u08 genCallEn)
@@ -122,10 +124,61 @@ inline void i2cSendStop(void)
 	outb(TWCR, (inb(TWCR)&TWCR_CMD_MASK)|BV(TWINT)|BV(TWEA)|BV(TWSTO));
 }
 
-inline void i2cWaitForComplete(void)
+inline u08 i2cWaitForComplete(void)
 {
-	// wait for i2c interface to complete operation
-	while( !(inb(TWCR) & BV(TWINT)) );
+	u16 timeout = I2C_TIMEOUT;
+
+	// wait for i2c interface to complete operation, or give up
+	while( !(inb(TWCR) & BV(TWINT)) )
+	{
+		if(!--timeout)
+			return I2C_ERROR_TIMEOUT;
+	}
+	return I2C_OK;
+}
+
+void i2cBusRecover(void)
+{
+	u08 i;
+
+	// switch off the TWI, it lets go of the pins
+	outb(TWCR, 0);
+	// SCL and SDA are open drain: driven low as outputs,
+	// let go as inputs with the pull-ups
+	cbi(I2C_DDR, I2C_SDA);
+	sbi(I2C_PORT, I2C_SDA);
+	cbi(I2C_DDR, I2C_SCL);
+	sbi(I2C_PORT, I2C_SCL);
+	_delay_us(5);
+
+	// a slave in the middle of sending a byte holds SDA low,
+	// clock it out (9 clocks at most: 8 bits and the ack)
+	for(i=0; (i<9) && !(inb(I2C_PIN) & BV(I2C_SDA)); i++)
+	{
+		cbi(I2C_PORT, I2C_SCL);
+		sbi(I2C_DDR, I2C_SCL);
+		_delay_us(5);
+		cbi(I2C_DDR, I2C_SCL);
+		sbi(I2C_PORT, I2C_SCL);
+		_delay_us(5);
+	}
+
+	// then a stop condition: SDA goes high while SCL is high
+	cbi(I2C_PORT, I2C_SCL);
+	sbi(I2C_DDR, I2C_SCL);
+	cbi(I2C_PORT, I2C_SDA);
+	sbi(I2C_DDR, I2C_SDA);
+	_delay_us(5);
+	cbi(I2C_DDR, I2C_SCL);
+	sbi(I2C_PORT, I2C_SCL);
+	_delay_us(5);
+	cbi(I2C_DDR, I2C_SDA);
+	sbi(I2C_PORT, I2C_SDA);
+	_delay_us(5);
+
+	// and start over like i2cInit() does
+	outb(TWCR, BV(TWEN)|BV(TWIE)|BV(TWEA));
+	I2cState = I2C_IDLE;
 }
 
 inline void i2cSendByte(u08 data)
@@ -176,6 +229,8 @@ void i2cMasterSend(u08 deviceAddr, u08 length, u08* data)
 		I2cSendData[i] = *data++;
 	I2cSendDataIndex = 0;
 	I2cSendDataLength = length;
+	I2cReceiveDataLength = 0;
+	i2cMasterDone = 0;
 	// send start condition
 	i2cSendStart();
 }
@@ -191,6 +246,7 @@ void i2cMasterReceive(u08 deviceAddr, u08 length, u08* data)
 	I2cDeviceAddrRW = (deviceAddr|0x01);	// RW set: read operation
 	I2cReceiveDataIndex = 0;
 	I2cReceiveDataLength = length;
+	i2cMasterDone = 0;
 	// send start condition
 	i2cSendStart();
 	// wait for data
@@ -200,163 +256,173 @@ void i2cMasterReceive(u08 deviceAddr, u08 length, u08* data)
 	  *data++ = I2cReceiveData[i];
 }
 
-u08 i2cMasterSendNI(u08 deviceAddr, u08 length, u08* data)
+u08 i2cMasterTransfer(u08 deviceAddr, u08 sendlength, u08* senddata, u08 receivelength,
+	void (*done)(u08 status, u08 length, u08* data))
 {
-	u08 retval = I2C_OK;
-
-	// disable TWI interrupt
-	cbi(TWCR, TWIE);
-
-	// send start condition
-	i2cSendStart();
-	i2cWaitForComplete();
-
-	// send device address with write
-	i2cSendByte( deviceAddr & 0xFE );
-	i2cWaitForComplete();
+	u08 i;
+	u08 sreg = SREG;
 
-	// check if device is present and live
-	if( inb(TWSR) == TW_MT_SLA_ACK)
+	// don't wait for the interface, we may be called from an interrupt
+	cli();
+	if(I2cState)
 	{
-		// send data
-		while(length)
-		{
-			i2cSendByte( *data++ );
-			i2cWaitForComplete();
-			length--;
-		}
+		SREG = sreg;
+		return I2C_ERROR_BUSY;
+	}
+	// set state
+	if(sendlength)
+	{
+		I2cState = I2C_MASTER_TX;
+		I2cDeviceAddrRW = (deviceAddr & 0xFE);	// RW cleared: write operation
 	}
 	else
 	{
-		// device did not ACK it's address,
-		// data will not be transferred
-		// return error
-		retval = I2C_ERROR_NODEV;
+		I2cState = I2C_MASTER_RX;
+		I2cDeviceAddrRW = (deviceAddr|0x01);	// RW set: read operation
 	}
+	SREG = sreg;
 
-	// transmit stop condition
-	// leave with TWEA on for slave receiving
-	i2cSendStop();
-	while( !(inb(TWCR) & BV(TWSTO)) );
-
-	// enable TWI interrupt
-	sbi(TWCR, TWIE);
-
-	return retval;
+	// save data
+	for(i=0; i<sendlength; i++)
+		I2cSendData[i] = *senddata++;
+	I2cSendDataIndex = 0;
+	I2cSendDataLength = sendlength;
+	I2cReceiveDataIndex = 0;
+	I2cReceiveDataLength = receivelength;
+	i2cMasterDone = done;
+	// send start condition, the interrupt does the rest
+	i2cSendStart();
+	return I2C_OK;
 }
 
-u08 i2cMasterReceiveNI(u08 deviceAddr, u08 length, u08 *data)
+// send a start condition, or a byte, and wait until it is out:
+// I2C_OK if the status is then what we expect
+static u08 i2cStartNI(u08 status)
 {
-	u08 retval = I2C_OK;
-
-	// disable TWI interrupt
-	cbi(TWCR, TWIE);
-
-	// send start condition
 	i2cSendStart();
-	i2cWaitForComplete();
-
-	// send device address with read
-	i2cSendByte( deviceAddr | 0x01 );
-	i2cWaitForComplete();
-
-	// check if device is present and live
-	if( inb(TWSR) == TW_MR_SLA_ACK)
-	{
-		// accept receive data and ack it
-		while(length > 1)
-		{
-			i2cReceiveByte(TRUE);
-			i2cWaitForComplete();
-			*data++ = i2cGetReceivedByte();
-			// decrement length
-			length--;
-		}
-
-		// accept receive data and nack it (last-byte signal)
-		i2cReceiveByte(FALSE);
-		i2cWaitForComplete();
-		*data++ = i2cGetReceivedByte();
-	}
-	else
-	{
-		// device did not ACK it's address,
-		// data will not be transferred
-		// return error
-		retval = I2C_ERROR_NODEV;
-	}
+	if(i2cWaitForComplete())
+		return I2C_ERROR_TIMEOUT;
+	if((inb(TWSR) & TWSR_STATUS_MASK) != status)
+		return I2C_ERROR_BUS;
+	return I2C_OK;
+}
 
-	// transmit stop condition
-	// leave with TWEA on for slave receiving
-	i2cSendStop();
+static u08 i2cSendByteNI(u08 data, u08 status)
+{
+	i2cSendByte(data);
+	if(i2cWaitForComplete())
+		return I2C_ERROR_TIMEOUT;
+	if((inb(TWSR) & TWSR_STATUS_MASK) != status)
+		return I2C_ERROR_NODEV;
+	return I2C_OK;
+}
 
-	// enable TWI interrupt
-	sbi(TWCR, TWIE);
+u08 i2cMasterSendNI(u08 deviceAddr, u08 length, u08* data)
+{
+	return i2cMasterTransferNI(deviceAddr, length, data, 0, 0);
+}
 
-	return retval;
+u08 i2cMasterReceiveNI(u08 deviceAddr, u08 length, u08 *data)
+{
+	return i2cMasterTransferNI(deviceAddr, 0, 0, length, data);
 }
-/*
-void i2cMasterTransferNI(u08 deviceAddr, u08 sendlength, u08* senddata, u08 receivelength, u08* receivedata)
+
+u08 i2cMasterTransferNI(u08 deviceAddr, u08 sendlength, u08* senddata, u08 receivelength, u08* receivedata)
 {
+	u08 retval;
+	u16 timeout = I2C_TIMEOUT;
+
 	// disable TWI interrupt
 	cbi(TWCR, TWIE);
 
 	// send start condition
-	i2cSendStart();
-	i2cWaitForComplete();
+	retval = i2cStartNI(TW_START);
 
 	// if there's data to be sent, do it
-	if(sendlength)
+	if(sendlength && (retval == I2C_OK))
 	{
-		// send device address with write
-		i2cSendByte( deviceAddr & 0xFE );
-		i2cWaitForComplete();
-		
+		// send device address with write,
+		// check if device is present and live
+		retval = i2cSendByteNI(deviceAddr & 0xFE, TW_MT_SLA_ACK);
+
 		// send data
-		while(sendlength)
+		while(sendlength && (retval == I2C_OK))
 		{
-			i2cSendByte( *senddata++ );
-			i2cWaitForComplete();
+			retval = i2cSendByteNI(*senddata++, TW_MT_DATA_ACK);
 			sendlength--;
 		}
+
+		// send repeated start condition, the bus stays ours
+		// and the device keeps the register address we just sent
+		if(receivelength && (retval == I2C_OK))
+			retval = i2cStartNI(TW_REP_START);
 	}
 
 	// if there's data to be received, do it
-	if(receivelength)
+	if(receivelength && (retval == I2C_OK))
 	{
-		// send repeated start condition
-		i2cSendStart();
-		i2cWaitForComplete();
+		// send device address with read,
+		// check if device is present and live
+		retval = i2cSendByteNI(deviceAddr | 0x01, TW_MR_SLA_ACK);
 
-		// send device address with read
-		i2cSendByte( deviceAddr | 0x01 );
-		i2cWaitForComplete();
-
-		// accept receive data and ack it
-		while(receivelength > 1)
+		while(receivelength && (retval == I2C_OK))
 		{
-			i2cReceiveByte(TRUE);
-			i2cWaitForComplete();
+			// accept receive data and ack it,
+			// nack the last byte (last-byte signal)
+			i2cReceiveByte(receivelength > 1);
+			retval = i2cWaitForComplete();
 			*receivedata++ = i2cGetReceivedByte();
 			// decrement length
 			receivelength--;
 		}
+	}
 
-		// accept receive data and nack it (last-byte signal)
-		i2cReceiveByte(TRUE);
-		i2cWaitForComplete();
-		*receivedata++ = i2cGetReceivedByte();
+	if(retval != I2C_ERROR_TIMEOUT)
+	{
+		// transmit stop condition
+		// leave with TWEA on for slave receiving
+		i2cSendStop();
+		// TWSTO clears once the stop condition is out
+		while((inb(TWCR) & BV(TWSTO)) && --timeout);
+		if(!timeout)
+			retval = I2C_ERROR_TIMEOUT;
 	}
-	
-	// transmit stop condition
-	// leave with TWEA on for slave receiving
-	i2cSendStop();
-	while( !(inb(TWCR) & BV(TWSTO)) );
+
+	// the TWI or the bus is stuck
+	if(retval == I2C_ERROR_TIMEOUT)
+		i2cBusRecover();
 
 	// enable TWI interrupt
 	sbi(TWCR, TWIE);
+
+	return retval;
+}
+
+// the master transfer is over, tell whoever started it
+static void i2cMasterFinish(u08 status)
+{
+	void (*done)(u08 status, u08 length, u08* data) = i2cMasterDone;
+
+	i2cMasterDone = 0;
+	// set state
+	I2cState = I2C_IDLE;
+	if(done) done(status, I2cReceiveDataIndex, I2cReceiveData);
+}
+
+void i2cMasterAbort(void)
+{
+	u08 sreg = SREG;
+
+	cli();
+	if((I2cState == I2C_MASTER_TX) || (I2cState == I2C_MASTER_RX))
+	{
+		// the interrupt never came: free the bus
+		// and tell whoever started the transfer
+		i2cBusRecover();
+		i2cMasterFinish(I2C_ERROR_TIMEOUT);
+	}
+	SREG = sreg;
 }
-*/
 
 //! I2C (TWI) interrupt service routine
 SIGNAL(TWI_vect)
@@ -387,12 +453,19 @@ SIGNAL(TWI_vect)
 			// send data
 			i2cSendByte( I2cSendData[I2cSendDataIndex++] );
 		}
+		else if(I2cReceiveDataLength)
+		{
+			// go on reading from the same device:
+			// send repeated start condition, then the address with read
+			I2cDeviceAddrRW |= 0x01;
+			I2cState = I2C_MASTER_RX;
+			i2cSendStart();
+		}
 		else
 		{
 			// transmit stop condition, enable SLA ACK
 			i2cSendStop();
-			// set state
-			I2cState = I2C_IDLE;
+			i2cMasterFinish(I2C_OK);
 		}
 		break;
 	case TW_MR_DATA_NACK:				// 0x58: Data received, NACK reply issued
@@ -401,7 +474,10 @@ SIGNAL(TWI_vect)
 		#endif
 		// store final received data byte
 		I2cReceiveData[I2cReceiveDataIndex++] = inb(TWDR);
-		// continue to transmit STOP condition
+		// transmit stop condition, enable SLA ACK
+		i2cSendStop();
+		i2cMasterFinish(I2C_OK);
+		break;
 	case TW_MR_SLA_NACK:				// 0x48: Slave address not acknowledged
 	case TW_MT_SLA_NACK:				// 0x20: Slave address not acknowledged
 	case TW_MT_DATA_NACK:				// 0x30: Data not acknowledged
@@ -410,8 +486,7 @@ SIGNAL(TWI_vect)
 		#endif
 		// transmit stop condition, enable SLA ACK
 		i2cSendStop();
-		// set state
-		I2cState = I2C_IDLE;
+		i2cMasterFinish(I2C_ERROR_NODEV);
 		break;
 	case TW_MT_ARB_LOST:				// 0x38: Bus arbitration lost
 	//case TW_MR_ARB_LOST:				// 0x38: Bus arbitration lost
@@ -420,8 +495,7 @@ SIGNAL(TWI_vect)
 		#endif
 		// release bus
 		outb(TWCR, (inb(TWCR)&TWCR_CMD_MASK)|BV(TWINT));
-		// set state
-		I2cState = I2C_IDLE;
+		i2cMasterFinish(I2C_ERROR_BUS);
 		// release bus and transmit start when bus is free
 		//outb(TWCR, (inb(TWCR)&TWCR_CMD_MASK)|BV(TWINT)|BV(TWSTA));
 		break;
@@ -430,9 +504,7 @@ SIGNAL(TWI_vect)
 	        putstring("I2C: MR->DATA_ACK\r\n");
 		#endif
 		// store received data byte
-		uint8_t x = inb(TWDR);
-		I2cReceiveData[I2cReceiveDataIndex++] = x;
-		uart_putw_hex(x);
+		I2cReceiveData[I2cReceiveDataIndex++] = inb(TWDR);
 		// fall-through to see if more bytes will be received
 	case TW_MR_SLA_ACK:					// 0x40: Slave address acknowledged
 		#ifdef I2C_DEBUG
@@ -556,8 +628,7 @@ SIGNAL(TWI_vect)
 		#endif
 		// reset internal hardware and release bus
 		outb(TWCR, (inb(TWCR)&TWCR_CMD_MASK)|BV(TWINT)|BV(TWSTO)|BV(TWEA));
-		// set state
-		I2cState = I2C_IDLE;
+		i2cMasterFinish(I2C_ERROR_BUS);
 		break;
 	}
 }
@@ -114,6 +114,9 @@
 // return values
 #define I2C_OK				0x00
 #define I2C_ERROR_NODEV		0x01
+#define I2C_ERROR_BUSY		0x02
+#define I2C_ERROR_BUS		0x03
+#define I2C_ERROR_TIMEOUT	0x04
 
 // types
 typedef enum
@@ -146,7 +149,12 @@ void i2cSendStart(void);
 //! Send an I2C stop condition in Master mode
 void i2cSendStop(void);
 //! Wait for current I2C operation to complete
-void i2cWaitForComplete(void);
+// Gives up after I2C_TIMEOUT polls and returns I2C_ERROR_TIMEOUT, else I2C_OK.
+u08 i2cWaitForComplete(void);
+//! Free a stuck bus and restart the TWI
+// Clocks SCL until a slave that holds SDA low lets go (9 times at most),
+// sends a stop condition and enables the TWI again like i2cInit().
+void i2cBusRecover(void);
 //! Send an (address|R/W) combination or a data byte over I2C
 void i2cSendByte(u08 data);
 //! Receive a data byte over I2C  
@@ -164,11 +172,28 @@ u08 i2cGetStatus(void);
 void i2cMasterSend(u08 deviceAddr, u08 length, u08 *data);
 //! receive I2C data from a device on the bus
 void i2cMasterReceive(u08 deviceAddr, u08 length, u08* data);
+//! send and then receive I2C data from a device on the bus, without waiting
+// Returns I2C_ERROR_BUSY if a transfer is already going on, else I2C_OK and
+// the TWI interrupt does the transfer, with a repeated start between the
+// write and the read.  When it is over, i2cGetState() is
+// I2C_IDLE again and done (if not 0) is called from the interrupt with the
+// result (I2C_OK or an error) and the data received.
+u08 i2cMasterTransfer(u08 deviceAddr, u08 sendlength, u08* senddata, u08 receivelength,
+	void (*done)(u08 status, u08 length, u08* data));
+
+//! give up on a transfer started with i2cMasterTransfer() that never finished
+// The bus is recovered and the transfer ends with I2C_ERROR_TIMEOUT.
+void i2cMasterAbort(void);
 
 //! send I2C data to a device on the bus (non-interrupt based)
+// The non-interrupt functions return I2C_OK or an error.  After a timeout
+// they have already called i2cBusRecover(), so they can just be tried again.
 u08 i2cMasterSendNI(u08 deviceAddr, u08 length, u08* data);
 //! receive I2C data from a device on the bus (non-interrupt based)
 u08 i2cMasterReceiveNI(u08 deviceAddr, u08 length, u08 *data);
+//! send and then receive I2C data from a device on the bus (non-interrupt based)
+// The read follows the write with a repeated start, as register reads need.
+u08 i2cMasterTransferNI(u08 deviceAddr, u08 sendlength, u08* senddata, u08 receivelength, u08* receivedata);
 
 //! Get the current high-level state of the I2C interface
 eI2cStateType i2cGetState(void);
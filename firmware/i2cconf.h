@@ -25,4 +25,15 @@
 #define I2C_SEND_DATA_BUFFER_SIZE		0x20
 #define I2C_RECEIVE_DATA_BUFFER_SIZE	0x20
 
+// the TWI pins, for the pull-ups and for clearing a stuck bus (ATmegaxx8)
+#define I2C_PORT	PORTC
+#define I2C_DDR		DDRC
+#define I2C_PIN		PINC
+#define I2C_SCL		5
+#define I2C_SDA		4
+
+// how many times to poll for the TWI to finish a step before giving up
+// (a poll is about 1us at 8MHz, a byte takes 90us at 100kHz)
+#define I2C_TIMEOUT	1000
+
 #endif
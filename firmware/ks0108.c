@@ -23,15 +23,53 @@
 // AVR specific includes
 	#include <avr/io.h>
 	#include <avr/interrupt.h>
+	#include <avr/pgmspace.h>
 #endif
 
 #include "global.h"
 #include "ks0108.h"
 
 #include "util.h"
+
+#include <string.h>
+
+#ifdef GLCD_TIMED_INTERFACE
+// cpu cycles needed to cover [ns] nanoseconds at F_CPU, rounded up
+#define GLCD_NS_TO_CYCLES(ns)	((((unsigned long)(ns))*(F_CPU/1000000UL)+999)/1000)
+// hold the enable line long enough for the controller to latch the data
+#define glcdEnableDelay()		__builtin_avr_delay_cycles(GLCD_NS_TO_CYCLES(GLCD_TIMED_E_HIGH_NS))
+#else
+#define glcdEnableDelay()		do { \
+	asm volatile ("nop"); asm volatile ("nop"); \
+	asm volatile ("nop"); asm volatile ("nop"); \
+	asm volatile ("nop"); asm volatile ("nop"); \
+	asm volatile ("nop"); asm volatile ("nop"); \
+	} while(0)
+#endif
+
 // global variables
 GrLcdStateType GrLcdState;
 
+#ifdef GLCD_TIMED_INTERFACE
+// accesses left until the busy flag is checked again
+u08 GrLcdTimedCount = 1;
+// set once the panel has been caught busy, we poll before every access after that
+u08 GrLcdTimedPolling = 0;
+#endif
+
+#ifdef GLCD_SHADOW_BUFFER
+u08 GrLcdBuffer[GLCD_NUM_PAGES][GLCD_XPIXELS];
+GrLcdDirtyType GrLcdDirty[GLCD_NUM_PAGES];
+#ifdef GLCD_ASYNC_FLUSH
+// page and column range the flush interrupt is working on
+u08 GrLcdFlushPage;
+u08 GrLcdFlushX = 0xFF;
+u08 GrLcdFlushXMax = 0;
+// set when more was drawn while a flush was running, so it goes round again
+volatile u08 GrLcdFlushRescan;
+#endif
+#endif
+
 /*************************************************************/
 /********************** LOCAL FUNCTIONS **********************/
 /*************************************************************/
@@ -127,13 +165,22 @@ void glcdControllerSelect(u08 controller)
 
 }
 
-void glcdBusyWait(u08 controller)
-{
 #ifdef GLCD_PORT_INTERFACE
-	cli();
-	// wait until LCD busy bit goes to zero
-	// select the controller chip
-	glcdControllerSelect(controller);
+// wait until the selected controller's busy bit goes to zero
+// (interrupts must be off, leaves the data port as output)
+static inline void glcdBusyPoll(void)
+{
+#ifdef GLCD_TIMED_INTERFACE
+	if(!GrLcdTimedPolling && --GrLcdTimedCount)
+	{
+		// trust the datasheet timing, the enable strobe was long enough
+		// and the controller is done by the time E has been low this long
+		__builtin_avr_delay_cycles(GLCD_NS_TO_CYCLES(GLCD_TIMED_E_LOW_NS));
+		return;
+	}
+	// every so often check the busy flag, just to be sure
+	GrLcdTimedCount = GLCD_TIMED_CHECK;
+#endif
 	// do a read from control register
 	//outb(GLCD_DATA_PORT, 0xFF);
 	GLCD_DATAH_PORT |= 0xF0;
@@ -149,6 +196,10 @@ void glcdBusyWait(u08 controller)
 	//while(inb(GLCD_DATA_PIN) & GLCD_STATUS_BUSY)
 	while(((GLCD_DATAH_PIN & 0xF0) | (GLCD_DATAL_PIN & 0x0F)) & GLCD_STATUS_BUSY)
 	{
+#ifdef GLCD_TIMED_INTERFACE
+		// this panel is slower than the timing assumes, go back to polling
+		GrLcdTimedPolling = 1;
+#endif
 		cbi(GLCD_CTRL_E_PORT, GLCD_CTRL_E);
 		asm volatile ("nop"); asm volatile ("nop");
 		asm volatile ("nop"); asm volatile ("nop");
@@ -161,7 +212,19 @@ void glcdBusyWait(u08 controller)
 	//	outb(GLCD_DATA_DDR, 0xFF);
 	GLCD_DATAH_DDR |= 0xF0;
 	GLCD_DATAL_DDR |= 0x0F;
-	sei();
+}
+#endif
+
+void glcdBusyWait(u08 controller)
+{
+#ifdef GLCD_PORT_INTERFACE
+	u08 sreg = SREG;
+	cli();
+	// wait until LCD busy bit goes to zero
+	// select the controller chip
+	glcdControllerSelect(controller);
+	glcdBusyPoll();
+	SREG = sreg;
 #else
 	// sbi(MCUCR, SRW);			// enable RAM waitstate
 	// wait until LCD busy bit goes to zero
@@ -174,6 +237,7 @@ void glcdBusyWait(u08 controller)
 void glcdControlWrite(u08 controller, u08 data)
 {
 #ifdef GLCD_PORT_INTERFACE
+	u08 sreg = SREG;
 	cli();
 	glcdBusyWait(controller);	// wait until LCD not busy
 	cbi(GLCD_CTRL_RS_PORT, GLCD_CTRL_RS);
@@ -187,12 +251,9 @@ void glcdControlWrite(u08 controller, u08 data)
 	GLCD_DATAH_PORT |= data & 0xF0; // set top nibble
 	GLCD_DATAL_PORT &= ~0x0F; // clear bottom nibble
 	GLCD_DATAL_PORT |= data & 0x0F; // set bottom nibble
-	asm volatile ("nop"); asm volatile ("nop");
-	asm volatile ("nop"); asm volatile ("nop");
-	asm volatile ("nop"); asm volatile ("nop");
-	asm volatile ("nop"); asm volatile ("nop");
+	glcdEnableDelay();
 	cbi(GLCD_CTRL_E_PORT, GLCD_CTRL_E);
-	sei();
+	SREG = sreg;
 #else
 	//sbi(MCUCR, SRW);				// enable RAM waitstate
 	glcdBusyWait(controller);		// wait until LCD not busy
@@ -205,6 +266,7 @@ u08 glcdControlRead(u08 controller)
 {
 	register u08 data;
 #ifdef GLCD_PORT_INTERFACE
+	u08 sreg = SREG;
 	cli();
 	glcdBusyWait(controller);		// wait until LCD not busy
 	cbi(GLCD_CTRL_RS_PORT, GLCD_CTRL_RS);
@@ -224,7 +286,7 @@ u08 glcdControlRead(u08 controller)
 	//outb(GLCD_DATA_DDR, 0xFF);
 	GLCD_DATAH_DDR |= 0xF0;
 	GLCD_DATAL_DDR |= 0x0F;
-	sei();
+	SREG = sreg;
 #else
 	//sbi(MCUCR, SRW);				// enable RAM waitstate
 	glcdBusyWait(controller);		// wait until LCD not busy
@@ -234,10 +296,10 @@ u08 glcdControlRead(u08 controller)
 	return data;
 }
 
-void glcdDataWrite(u08 data)
+void glcdControllerDataWrite(u08 controller, u08 data)
 {
-	register u08 controller = (GrLcdState.lcdXAddr/GLCD_CONTROLLER_XPIXELS);
 #ifdef GLCD_PORT_INTERFACE
+	u08 sreg = SREG;
 	cli();
 	glcdBusyWait(controller);		// wait until LCD not busy
 	sbi(GLCD_CTRL_RS_PORT, GLCD_CTRL_RS);
@@ -253,35 +315,215 @@ void glcdDataWrite(u08 data)
 	GLCD_DATAL_PORT &= ~0x0F; // clear bottom nibble
 	GLCD_DATAL_PORT |= data & 0x0F; // set bottom nibble
 
-	asm volatile ("nop"); asm volatile ("nop");
-	asm volatile ("nop"); asm volatile ("nop");
-	asm volatile ("nop"); asm volatile ("nop");
-	asm volatile ("nop"); asm volatile ("nop");
+	glcdEnableDelay();
 	cbi(GLCD_CTRL_E_PORT, GLCD_CTRL_E);
-	sei();
+	SREG = sreg;
 #else
 	//sbi(MCUCR, SRW);				// enable RAM waitstate
 	glcdBusyWait(controller);		// wait until LCD not busy
 	*(volatile unsigned char *) (GLCD_CONTROLLER0_CTRL_ADDR + GLCD_CONTROLLER_ADDR_OFFSET*controller) = data;
 	//cbi(MCUCR, SRW);				// disable RAM waitstate
 #endif
-	
+	// the controller advances its column address by itself
+	// (and wraps around at the end of its 64 columns)
+	if((controller < GLCD_NUM_CONTROLLERS) && (GrLcdState.ctrlr[controller].xAddr < GLCD_CONTROLLER_XPIXELS))
+		GrLcdState.ctrlr[controller].xAddr = (GrLcdState.ctrlr[controller].xAddr+1) & (GLCD_CONTROLLER_XPIXELS-1);
+}
+
+void glcdControllerWriteBurst(u08 controller, const u08 *buf, u08 len, u08 mode)
+{
+	register u08 data;
+	u08 count = len;
+
+	if(controller >= GLCD_NUM_CONTROLLERS)
+		return;
+#ifdef GLCD_PORT_INTERFACE
+	u08 sreg = SREG;
+	cli();
+	// select the controller once for the whole run
+	glcdControllerSelect(controller);
+	while(count--)
+	{
+		if(mode == GLCD_BURST_PROGMEM)
+			data = pgm_read_byte(buf++);
+		else if(mode == GLCD_BURST_RAM)
+			data = *buf++;
+		else
+			data = *buf;
+
+		// the controller is busy for a few of its own clocks after
+		// every write, so this is the only part we have to repeat
+		// (in timed mode it is mostly just a short delay)
+		glcdBusyPoll();
+		sbi(GLCD_CTRL_RS_PORT, GLCD_CTRL_RS);
+		sbi(GLCD_CTRL_E_PORT, GLCD_CTRL_E);
+		GLCD_DATAH_PORT = (GLCD_DATAH_PORT & ~0xF0) | (data & 0xF0);
+		GLCD_DATAL_PORT = (GLCD_DATAL_PORT & ~0x0F) | (data & 0x0F);
+		glcdEnableDelay();
+		cbi(GLCD_CTRL_E_PORT, GLCD_CTRL_E);
+	}
+	SREG = sreg;
+#else
+	while(count--)
+	{
+		if(mode == GLCD_BURST_PROGMEM)
+			data = pgm_read_byte(buf++);
+		else if(mode == GLCD_BURST_RAM)
+			data = *buf++;
+		else
+			data = *buf;
+		glcdBusyWait(controller);		// wait until LCD not busy
+		*(volatile unsigned char *) (GLCD_CONTROLLER0_CTRL_ADDR + GLCD_CONTROLLER_ADDR_OFFSET*controller) = data;
+	}
+#endif
+	// the column moved on by one per byte
+	if(GrLcdState.ctrlr[controller].xAddr < GLCD_CONTROLLER_XPIXELS)
+		GrLcdState.ctrlr[controller].xAddr = (GrLcdState.ctrlr[controller].xAddr+len) & (GLCD_CONTROLLER_XPIXELS-1);
+}
+
+void glcdControllerSetAddress(u08 controller, u08 page, u08 col)
+{
+	// off the right edge of the display, there is nobody to talk to
+	if(controller >= GLCD_NUM_CONTROLLERS)
+		return;
+	// only send the registers that actually change
+	page &= (GLCD_NUM_PAGES-1);
+	if(GrLcdState.ctrlr[controller].yAddr != page)
+	{
+		glcdControlWrite(controller, GLCD_SET_PAGE | page);
+		GrLcdState.ctrlr[controller].yAddr = page;
+	}
+	if(GrLcdState.ctrlr[controller].xAddr != col)
+	{
+		glcdControlWrite(controller, GLCD_SET_Y_ADDR | col);
+		GrLcdState.ctrlr[controller].xAddr = col;
+	}
+}
+
+void glcdControllerStartLine(u08 start)
+{
+	u08 i;
+	for(i=0; i<GLCD_NUM_CONTROLLERS; i++)
+	{
+		if(GrLcdState.ctrlr[i].startLine != start)
+		{
+			glcdControlWrite(i, GLCD_START_LINE | start);
+			GrLcdState.ctrlr[i].startLine = start;
+		}
+	}
+}
+
+void glcdDataWrite(u08 data)
+{
+#ifdef GLCD_SHADOW_BUFFER
+	// draw into the shadow buffer, glcdFlush() sends it out
+	if(GrLcdState.lcdYAddr < GLCD_NUM_PAGES)
+	{
+		GrLcdBuffer[GrLcdState.lcdYAddr][GrLcdState.lcdXAddr] = data;
+		glcdBufferDirty(GrLcdState.lcdYAddr, GrLcdState.lcdXAddr, GrLcdState.lcdXAddr);
+	}
+	GrLcdState.lcdXAddr++;
+	if(GrLcdState.lcdXAddr >= GLCD_XPIXELS)
+	{
+		GrLcdState.lcdYAddr = (GrLcdState.lcdYAddr+1) & (GLCD_NUM_PAGES-1);
+		GrLcdState.lcdXAddr = 0;
+	}
+#else
+	register u08 controller = (GrLcdState.lcdXAddr/GLCD_CONTROLLER_XPIXELS);
+
+	// catch the controller up with our position; this sends nothing
+	// unless we just crossed onto it or wrapped to a new page
+	glcdControllerSetAddress(controller, GrLcdState.lcdYAddr, GrLcdState.lcdXAddr & (GLCD_CONTROLLER_XPIXELS-1));
+	glcdControllerDataWrite(controller, data);
+
 	// increment our local address counter
-	GrLcdState.ctrlr[controller].xAddr++;
 	GrLcdState.lcdXAddr++;
 	if(GrLcdState.lcdXAddr >= GLCD_XPIXELS)
 	{
-	  GrLcdState.lcdYAddr++;
-	  glcdSetYAddress(GrLcdState.lcdYAddr);
-	  glcdSetXAddress(0);
+	  GrLcdState.lcdYAddr = (GrLcdState.lcdYAddr+1) & (GLCD_NUM_PAGES-1);
+	  GrLcdState.lcdXAddr = 0;
+	}
+#endif
+}
+
+static void glcdDataWriteRun(const u08 *buf, u08 len, u08 mode)
+{
+	register u08 n;
+#ifdef GLCD_SHADOW_BUFFER
+	register u08 *dst;
+
+	while(len)
+	{
+		// copy up to the end of the current page
+		n = GLCD_XPIXELS - GrLcdState.lcdXAddr;
+		if(n > len)
+			n = len;
+		if(GrLcdState.lcdYAddr < GLCD_NUM_PAGES)
+		{
+			glcdBufferDirty(GrLcdState.lcdYAddr, GrLcdState.lcdXAddr, GrLcdState.lcdXAddr+n-1);
+			dst = &GrLcdBuffer[GrLcdState.lcdYAddr][GrLcdState.lcdXAddr];
+			if(mode == GLCD_BURST_PROGMEM)
+				memcpy_P(dst, buf, n);
+			else if(mode == GLCD_BURST_RAM)
+				memcpy(dst, buf, n);
+			else
+				memset(dst, *buf, n);
+		}
+#else
+	register u08 controller;
+
+	while(len)
+	{
+		// send up to the end of the current controller in one burst
+		controller = GrLcdState.lcdXAddr/GLCD_CONTROLLER_XPIXELS;
+		n = GLCD_CONTROLLER_XPIXELS - (GrLcdState.lcdXAddr & (GLCD_CONTROLLER_XPIXELS-1));
+		if(n > len)
+			n = len;
+		glcdControllerSetAddress(controller, GrLcdState.lcdYAddr, GrLcdState.lcdXAddr & (GLCD_CONTROLLER_XPIXELS-1));
+		glcdControllerWriteBurst(controller, buf, n, mode);
+#endif
+		if(mode != GLCD_BURST_FILL)
+			buf += n;
+		len -= n;
+
+		// increment our local address counter
+		GrLcdState.lcdXAddr += n;
+		if(GrLcdState.lcdXAddr >= GLCD_XPIXELS)
+		{
+			GrLcdState.lcdYAddr = (GrLcdState.lcdYAddr+1) & (GLCD_NUM_PAGES-1);
+			GrLcdState.lcdXAddr = 0;
+		}
 	}
 }
 
+void glcdDataWriteBurst(const u08 *buf, u08 len)
+{
+	glcdDataWriteRun(buf, len, GLCD_BURST_RAM);
+}
+
+void glcdDataWriteBurst_P(const u08 *buf, u08 len)
+{
+	glcdDataWriteRun(buf, len, GLCD_BURST_PROGMEM);
+}
+
+void glcdDataFill(u08 data, u08 len)
+{
+	glcdDataWriteRun(&data, len, GLCD_BURST_FILL);
+}
+
 u08 glcdDataRead(void)
 {
 	register u08 data;
+#ifdef GLCD_SHADOW_BUFFER
+	// no dummy read needed, the buffer is always current
+	if(GrLcdState.lcdYAddr < GLCD_NUM_PAGES)
+		data = GrLcdBuffer[GrLcdState.lcdYAddr][GrLcdState.lcdXAddr];
+	else
+		data = 0;
+#else
 	register u08 controller = (GrLcdState.lcdXAddr/GLCD_CONTROLLER_XPIXELS);
 #ifdef GLCD_PORT_INTERFACE
+	u08 sreg = SREG;
 	cli();
 	glcdBusyWait(controller);		// wait until LCD not busy
 	sbi(GLCD_CTRL_RS_PORT, GLCD_CTRL_RS);
@@ -300,13 +542,18 @@ u08 glcdDataRead(void)
 
 	cbi(GLCD_CTRL_E_PORT, GLCD_CTRL_E);
 	cbi(GLCD_CTRL_RW_PORT, GLCD_CTRL_RW);
-	sei();
+	SREG = sreg;
 #else
 	//sbi(MCUCR, SRW);				// enable RAM waitstate
 	glcdBusyWait(controller);		// wait until LCD not busy
 	data = *(volatile unsigned char *) (GLCD_CONTROLLER0_CTRL_ADDR + GLCD_CONTROLLER_ADDR_OFFSET*controller);
 	//cbi(MCUCR, SRW);				// disable RAM waitstate
 #endif
+	// reads also move the column address (and the first one after an
+	// address change is a dummy), so just forget where the column is
+	if(controller < GLCD_NUM_CONTROLLERS)
+		GrLcdState.ctrlr[controller].xAddr = 0xFF;
+
 	// increment our local address counter
 
 	/*
@@ -318,6 +565,7 @@ u08 glcdDataRead(void)
 		glcdSetYAddress(GrLcdState.lcdYAddr);
 		glcdSetXAddress(0);
 		}*/
+#endif
 	return data;
 }
 
@@ -337,32 +585,23 @@ void glcdReset(u08 resetState)
 
 void glcdSetXAddress(u08 xAddr)
 {
-	u08 i;
 	// record address change locally
 	GrLcdState.lcdXAddr = xAddr;
 	
-	// clear y (col) address on all controllers
-	for(i=0; i<GLCD_NUM_CONTROLLERS; i++)
-	{
-		glcdControlWrite(i, GLCD_SET_Y_ADDR | 0x00);
-		GrLcdState.ctrlr[i].xAddr = 0;
-	}
-
-	// set y (col) address on destination controller
-	glcdControlWrite((GrLcdState.lcdXAddr/GLCD_CONTROLLER_XPIXELS),
-		GLCD_SET_Y_ADDR | (GrLcdState.lcdXAddr & 0x3F));
+	// set y (col) address on destination controller, the others are
+	// moved by glcdDataWrite() once we cross onto them
+	glcdControllerSetAddress((GrLcdState.lcdXAddr/GLCD_CONTROLLER_XPIXELS),
+		GrLcdState.lcdYAddr, GrLcdState.lcdXAddr & 0x3F);
 }
 
 void glcdSetYAddress(u08 yAddr)
 {
-	u08 i;
-	// record address change locally
-	GrLcdState.lcdYAddr = yAddr;
-	// set page address for all controllers
-	for(i=0; i<GLCD_NUM_CONTROLLERS; i++)
-	{
-		glcdControlWrite(i, GLCD_SET_PAGE | yAddr);
-	}
+	// record address change locally, as the display ram page
+	// that logical page [yAddr] is shown from
+	GrLcdState.lcdYAddr = glcdRamPage(yAddr);
+	// set page address for the destination controller
+	glcdControllerSetAddress((GrLcdState.lcdXAddr/GLCD_CONTROLLER_XPIXELS),
+		GrLcdState.lcdYAddr, GrLcdState.lcdXAddr & 0x3F);
 }
 
 /*************************************************************/
@@ -372,6 +611,13 @@ void glcdSetYAddress(u08 yAddr)
 void glcdInit()
 {
 	u08 i;
+	// we don't know what the controllers' registers hold yet
+	for(i=0; i<GLCD_NUM_CONTROLLERS; i++)
+	{
+		GrLcdState.ctrlr[i].xAddr = 0xFF;
+		GrLcdState.ctrlr[i].yAddr = 0xFF;
+		GrLcdState.ctrlr[i].startLine = 0xFF;
+	}
 	// initialize hardware
 	glcdInitHW();
 	// bring lcd out of reset
@@ -385,26 +631,32 @@ void glcdInit()
 	glcdClearScreen();
 	// initialize positions
 	glcdHome();
+#ifdef GLCD_SHADOW_BUFFER
+	// push the cleared buffer and start line out to the display
+	glcdFlush();
+#endif
 }
 
 void glcdHome(void)
 {
-	u08 i;
 	// initialize addresses/positions
+	// (GrLcdState.ctrlr[] follows the controllers by itself)
 	glcdStartLine(0);
 	glcdSetAddress(0,0);
-	// initialize local data structures
-	for(i=0; i<GLCD_NUM_CONTROLLERS; i++)
-	{
-		GrLcdState.ctrlr[i].xAddr = 0;
-		GrLcdState.ctrlr[i].yAddr = 0;
-	}
 }
 
 void glcdClearScreen(void)
 {
+#ifdef GLCD_SHADOW_BUFFER
+	u08 pageAddr;
+
+	memset(GrLcdBuffer, 0x00, sizeof(GrLcdBuffer));
+	for(pageAddr=0; pageAddr<GLCD_NUM_PAGES; pageAddr++)
+	{
+		glcdBufferDirty(pageAddr, 0, GLCD_XPIXELS-1);
+	}
+#else
 	u08 pageAddr;
-	u08 xAddr;
 
 	// clear LCD
 	// loop through all pages
@@ -413,24 +665,50 @@ void glcdClearScreen(void)
 		// set page address
 		glcdSetAddress(0, pageAddr);
 		// clear all lines of this page of display memory
-		for(xAddr=0; xAddr<GLCD_XPIXELS; xAddr++)
-		{
-			glcdDataWrite(0x00);
-		}
+		glcdDataFill(0x00, GLCD_XPIXELS);
 	}
+#endif
 }
 
 void glcdStartLine(u08 start)
 {
-	glcdControlWrite(0, GLCD_START_LINE | start);
-	glcdControlWrite(1, GLCD_START_LINE | start);
+	// drawing coordinates are translated by this from now on.  Only
+	// whole pages, so text and the other page writes stay logical too
+	GrLcdState.lcdStartLine = start & (GLCD_YPIXELS-1) & ~7;
+#ifndef GLCD_SHADOW_BUFFER
+	glcdControllerStartLine(GrLcdState.lcdStartLine);
+#endif
+	// (with a shadow buffer it goes out with the next glcdFlush())
+}
+
+void glcdScrollTo(u08 line)
+{
+	glcdStartLine(line);
+}
+
+void glcdScrollBy(s08 dy)
+{
+	glcdStartLine(GrLcdState.lcdStartLine + dy);
 }
 
 void glcdSetAddress(u08 x, u08 yLine)
 {
-	// set addresses
-	glcdSetYAddress(yLine);
-	glcdSetXAddress(x);
+	glcdSetRamAddress(x, glcdRamPage(yLine));
+}
+
+void glcdSetRamAddress(u08 x, u08 page)
+{
+#ifdef GLCD_SHADOW_BUFFER
+	// only the buffer position moves, the display is addressed by glcdFlush()
+	GrLcdState.lcdXAddr = x;
+	GrLcdState.lcdYAddr = page;
+#else
+	// set addresses, only the destination controller is touched
+	// and only if it isn't there already
+	GrLcdState.lcdXAddr = x;
+	GrLcdState.lcdYAddr = page;
+	glcdControllerSetAddress(x/GLCD_CONTROLLER_XPIXELS, page, x & 0x3F);
+#endif
 }
 
 void glcdGotoChar(u08 line, u08 col)
@@ -448,5 +726,167 @@ void glcdDelay(u16 p)			// 1-8us      ...2-13us     ...5-31us
 	for (i = 0; i < p; i++) for (j = 0; j < 10; j++);
 }
 
+#ifdef GLCD_SHADOW_BUFFER
+void glcdBufferDirty(u08 page, u08 x1, u08 x2)
+{
+	// the flush may take the range away from under us, so don't get interrupted
+	u08 sreg = SREG;
+	cli();
+	// grow the dirty range of this page to include x1..x2
+	if(x1 < GrLcdDirty[page].xMin)
+		GrLcdDirty[page].xMin = x1;
+	if(x2 > GrLcdDirty[page].xMax)
+		GrLcdDirty[page].xMax = x2;
+	SREG = sreg;
+}
+
+void glcdFlush(void)
+{
+	u08 page;
+	u08 x, xMax, n;
+	u08 controller;
+
+#ifdef GLCD_ASYNC_FLUSH
+	// take over from a background flush that is still running
+	cli();
+	GLCD_FLUSH_TIMSK &= ~_BV(GLCD_FLUSH_IE);
+	GrLcdFlushRescan = 0;
+	// hand back whatever it had not sent yet
+	if(GrLcdFlushX <= GrLcdFlushXMax)
+		glcdBufferDirty(GrLcdFlushPage, GrLcdFlushX, GrLcdFlushXMax);
+	GrLcdFlushX = 0xFF;
+	GrLcdFlushXMax = 0;
+	sei();
+#endif
+
+	for(page=0; page<GLCD_NUM_PAGES; page++)
+	{
+		// take the dirty range and mark the page clean in one go, so that
+		// anything drawn by an interrupt while we send is caught next time
+		cli();
+		x = GrLcdDirty[page].xMin;
+		xMax = GrLcdDirty[page].xMax;
+		GrLcdDirty[page].xMin = 0xFF;
+		GrLcdDirty[page].xMax = 0;
+		sei();
+
+		if(x > xMax)
+			continue;
+
+		// one burst per controller the range touches
+		while(x <= xMax)
+		{
+			controller = x/GLCD_CONTROLLER_XPIXELS;
+			n = GLCD_CONTROLLER_XPIXELS - (x & (GLCD_CONTROLLER_XPIXELS-1));
+			if(n > xMax - x + 1)
+				n = xMax - x + 1;
+			glcdControllerSetAddress(controller, page, x & (GLCD_CONTROLLER_XPIXELS-1));
+			glcdControllerWriteBurst(controller, &GrLcdBuffer[page][x], n, GLCD_BURST_RAM);
+			x += n;
+		}
+	}
+
+	glcdControllerStartLine(GrLcdState.lcdStartLine);
+}
+
+#ifdef GLCD_ASYNC_FLUSH
+void glcdFlushAsync(void)
+{
+	cli();
+	GrLcdFlushRescan = 1;
+	if(!(GLCD_FLUSH_TIMSK & _BV(GLCD_FLUSH_IE)))
+	{
+		// start from an empty range on the last page, so the
+		// interrupt wraps round to page 0 on its first pass
+		GrLcdFlushPage = GLCD_NUM_PAGES-1;
+		GrLcdFlushX = 0xFF;
+		GrLcdFlushXMax = 0;
+		GLCD_FLUSH_TIMSK |= _BV(GLCD_FLUSH_IE);
+	}
+	sei();
+}
+
+u08 glcdFlushBusy(void)
+{
+	return (GLCD_FLUSH_TIMSK & _BV(GLCD_FLUSH_IE)) != 0;
+}
+
+// sends up to GLCD_FLUSH_BYTES dirty columns each time the timer comes round
+SIGNAL(GLCD_FLUSH_vect)
+{
+	u08 n = GLCD_FLUSH_BYTES;
+	u08 len;
+	u08 controller;
+
+	while(n)
+	{
+		// done with this range, take the next dirty page
+		while(GrLcdFlushX > GrLcdFlushXMax)
+		{
+			if(++GrLcdFlushPage >= GLCD_NUM_PAGES)
+			{
+				if(!GrLcdFlushRescan)
+				{
+					// everything is out, stop until the next glcdFlushAsync()
+					GLCD_FLUSH_TIMSK &= ~_BV(GLCD_FLUSH_IE);
+					glcdControllerStartLine(GrLcdState.lcdStartLine);
+					return;
+				}
+				GrLcdFlushRescan = 0;
+				GrLcdFlushPage = 0;
+			}
+			GrLcdFlushX = GrLcdDirty[GrLcdFlushPage].xMin;
+			GrLcdFlushXMax = GrLcdDirty[GrLcdFlushPage].xMax;
+			GrLcdDirty[GrLcdFlushPage].xMin = 0xFF;
+			GrLcdDirty[GrLcdFlushPage].xMax = 0;
+		}
+
+		// no further than the end of the range or this controller
+		controller = GrLcdFlushX/GLCD_CONTROLLER_XPIXELS;
+		len = GLCD_CONTROLLER_XPIXELS - (GrLcdFlushX & (GLCD_CONTROLLER_XPIXELS-1));
+		if(len > GrLcdFlushXMax - GrLcdFlushX + 1)
+			len = GrLcdFlushXMax - GrLcdFlushX + 1;
+		if(len > n)
+			len = n;
+		glcdControllerSetAddress(controller, GrLcdFlushPage, GrLcdFlushX & (GLCD_CONTROLLER_XPIXELS-1));
+		glcdControllerWriteBurst(controller, &GrLcdBuffer[GrLcdFlushPage][GrLcdFlushX], len, GLCD_BURST_RAM);
+		GrLcdFlushX += len;
+		n -= len;
+	}
+}
+#endif
+#endif
+
+#ifdef GLCD_BENCHMARK
+void glcdBenchmark(void)
+{
+	u08 i, zero = 0;
+	u16 single, burst;
+
+	// time 64 writes to the first controller both ways with timer1
+	// running at the cpu clock (the screen has just been cleared, so
+	// writing zeros to it does not show)
+	TCCR1A = 0;
+	TCCR1B = _BV(CS10);
+	glcdControllerSetAddress(0, 0, 0);
+	TCNT1 = 0;
+	for(i=0; i<GLCD_CONTROLLER_XPIXELS; i++)
+	{
+		glcdControllerDataWrite(0, zero);
+	}
+	single = TCNT1;
+	glcdControllerSetAddress(0, 0, 0);
+	TCNT1 = 0;
+	glcdControllerWriteBurst(0, &zero, GLCD_CONTROLLER_XPIXELS, GLCD_BURST_FILL);
+	burst = TCNT1;
+	TCCR1B = 0;
+
+	putstring("glcd cycles/byte single: ");
+	uart_putw_dec(single/GLCD_CONTROLLER_XPIXELS);
+	putstring(" burst: ");
+	uart_putw_dec(burst/GLCD_CONTROLLER_XPIXELS);
+	putstring_nl("");
+}
+#endif
 
 // Higher level functionality has been moved to the API-layer glcd.c/glcd.h
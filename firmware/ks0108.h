@@ -58,31 +58,74 @@
 #define GLCD_STATUS_ONOFF	0x20	// (0)->LCD IS ON
 #define GLCD_STATUS_RESET	0x10	// (1)->LCD IS RESET
 
+// where glcdControllerWriteBurst() takes its bytes from
+#define GLCD_BURST_RAM		0	// buf is in SRAM
+#define GLCD_BURST_PROGMEM	1	// buf is in program memory
+#define GLCD_BURST_FILL		2	// repeat the byte buf points to
+
 // determine the number of controllers
 // (make sure we round up for partial use of more than one controller)
 #define GLCD_NUM_CONTROLLERS	((GLCD_XPIXELS+GLCD_CONTROLLER_XPIXELS-1)/GLCD_CONTROLLER_XPIXELS)
+// number of 8-pixel high pages
+#define GLCD_NUM_PAGES			(GLCD_YPIXELS/8)
 
 // typedefs/structures
+// what each controller's registers currently hold, so that
+// commands which would not change anything can be skipped
+// (0xFF means unknown and forces the next command out)
 typedef struct struct_GrLcdCtrlrStateType
 {
-	unsigned char xAddr;
-	unsigned char yAddr;
+	unsigned char xAddr;		// column (KS0108 "Y address"), auto-increments
+	unsigned char yAddr;		// page (KS0108 "X address")
+	unsigned char startLine;	// display start line
 } GrLcdCtrlrStateType;
 
 typedef struct struct_GrLcdStateType
 {
 	unsigned char lcdXAddr;
-	unsigned char lcdYAddr;
+	unsigned char lcdYAddr;		// display ram page, not the logical one
+	unsigned char lcdStartLine;	// display start line (vertical scroll)
 	GrLcdCtrlrStateType ctrlr[GLCD_NUM_CONTROLLERS];
 } GrLcdStateType;
 
+extern GrLcdStateType GrLcdState;
+
+// drawing coordinates are logical, row 0 is always the top of the panel;
+// scrolling moves the start line so these translate them to display ram
+// (it only moves by whole pages, so a logical page is a display ram page)
+#define glcdRamLine(y)		(((y) + GrLcdState.lcdStartLine) & (GLCD_YPIXELS-1))
+#define glcdRamPage(page)	(((page) + (GrLcdState.lcdStartLine>>3)) & (GLCD_NUM_PAGES-1))
+
+#ifdef GLCD_SHADOW_BUFFER
+// range of columns in a page that differ from the display
+// (xMin > xMax when the page is clean)
+typedef struct struct_GrLcdDirtyType
+{
+	unsigned char xMin;
+	unsigned char xMax;
+} GrLcdDirtyType;
+
+// SRAM copy of display memory, one byte per column per page
+extern u08 GrLcdBuffer[GLCD_NUM_PAGES][GLCD_XPIXELS];
+#endif
+
 // function prototypes
 void glcdInitHW(void);
 void glcdBusyWait(u08 controller);
 void glcdControlWrite(u08 controller, u08 data);
 u08  glcdControlRead(u08 controller);
+void glcdControllerDataWrite(u08 controller, u08 data);
+void glcdControllerWriteBurst(u08 controller, const u08 *buf, u08 len, u08 mode);
+void glcdControllerSetAddress(u08 controller, u08 page, u08 col);
+void glcdControllerStartLine(u08 start);
 void glcdDataWrite(u08 data);
 u08  glcdDataRead(void);
+//! Write [len] bytes from [buf] starting at the current position
+void glcdDataWriteBurst(const u08 *buf, u08 len);
+//! Write [len] bytes from [buf] in program memory starting at the current position
+void glcdDataWriteBurst_P(const u08 *buf, u08 len);
+//! Write [data] [len] times starting at the current position
+void glcdDataFill(u08 data, u08 len);
 void glcdSetXAddress(u08 xAddr);
 void glcdSetYAddress(u08 yAddr);
 
@@ -97,8 +140,41 @@ void glcdHome(void);
 void glcdGotoChar(u08 line, u08 col);
 //! Set display memory access point to [x] horizontal pixel and [y] vertical line
 void glcdSetAddress(u08 x, u08 yLine);
-//! Set display memory access point to row [line] and column [col] assuming 5x7 font
+//! Set display memory access point to [x] horizontal pixel and display ram [page], ignoring the scroll
+void glcdSetRamAddress(u08 x, u08 page);
+//! Set the display start line, the same as glcdScrollTo()
 void glcdStartLine(u08 start);
+//! Scroll the whole display so that display ram line [line] is shown at the top,
+//! [line] is rounded down to a whole page (multiple of 8)
+void glcdScrollTo(u08 line);
+//! Scroll the whole display up by [dy] lines (down if negative), from
+//! where it is to a whole page, rounded down
+void glcdScrollBy(s08 dy);
 //! Generic delay routine for timed glcd access
 void glcdDelay(u16 p);
+
+#ifdef GLCD_SHADOW_BUFFER
+//! Mark columns [x1..x2] of page [page] as changed in the shadow buffer
+void glcdBufferDirty(u08 page, u08 x1, u08 x2);
+//! Send all changed columns of the shadow buffer to the display
+void glcdFlush(void);
+#else
+// everything is drawn straight to the display, nothing to flush
+#define glcdFlush()
+#endif
+
+#ifdef GLCD_ASYNC_FLUSH
+//! Send all changed columns of the shadow buffer from the flush interrupt
+void glcdFlushAsync(void);
+//! Returns non-zero while a background flush is still running
+u08 glcdFlushBusy(void);
+#else
+#define glcdFlushAsync()	glcdFlush()
+#define glcdFlushBusy()		0
+#endif
+
+#ifdef GLCD_BENCHMARK
+//! Print cycles per byte for single and burst data writes on the uart
+void glcdBenchmark(void);
+#endif
 #endif
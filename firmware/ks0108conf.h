@@ -34,6 +34,20 @@
 //#define GLCD_MEMORY_INTERFACE
 #define GLCD_PORT_INTERFACE
 
+// -GLCD_TIMED_INTERFACE (port interface only) stops reading the busy flag
+// before every access and instead waits out the KS0108 datasheet timing,
+// counted in cpu cycles from F_CPU.  The busy flag is still read once every
+// GLCD_TIMED_CHECK accesses; if the panel is ever caught busy the driver
+// goes back to polling before every access.
+// Off until it has been checked against a real panel, the timings have
+// only been taken from the datasheet.
+//#define GLCD_TIMED_INTERFACE
+#ifdef GLCD_TIMED_INTERFACE
+	#define GLCD_TIMED_E_HIGH_NS	450		// enable pulse width high (tWH)
+	#define GLCD_TIMED_E_LOW_NS		550		// enable low before the next access (tWL, tC-tWH)
+	#define GLCD_TIMED_CHECK		64		// accesses between busy flag checks
+#endif
+
 // GLCD_PORT_INTERFACE specifics
 #ifdef GLCD_PORT_INTERFACE
 	// make sure these parameters are not already defined elsewhere
@@ -101,6 +115,33 @@
 #define GLCD_YPIXELS			64		// pixel height of entire display
 #define GLCD_CONTROLLER_XPIXELS	64		// pixel width of one display controller
 
+// -GLCD_SHADOW_BUFFER keeps a copy of the display memory in SRAM
+// (GLCD_XPIXELS*GLCD_YPIXELS/8 bytes, 1KB for 128x64).  All drawing then
+// happens in RAM without reading back from the LCD, and glcdFlush() sends
+// only the columns that changed to the display.
+// Comment out to draw directly to the display and save the RAM.
+#define GLCD_SHADOW_BUFFER
+
+// -GLCD_ASYNC_FLUSH (shadow buffer only) adds glcdFlushAsync(), which hands
+// the changed columns to a timer compare interrupt that sends up to
+// GLCD_FLUSH_BYTES of them each time it fires, so the main loop can go on
+// with the next frame while the last one is still going out.  The timer
+// itself is run by the application (ratt.c fires it once per 1ms tick).
+// Comment out to only flush from the main loop.
+#ifdef GLCD_SHADOW_BUFFER
+#define GLCD_ASYNC_FLUSH
+#endif
+#ifdef GLCD_ASYNC_FLUSH
+	#define GLCD_FLUSH_vect		TIMER0_COMPB_vect
+	#define GLCD_FLUSH_TIMSK	TIMSK0
+	#define GLCD_FLUSH_IE		OCIE0B
+	#define GLCD_FLUSH_BYTES	16		// 1KB screen in 64 ticks
+#endif
+
+// -GLCD_BENCHMARK makes glcdBenchmark() available, which times single and
+// burst data writes and prints the cycles per byte on the uart at startup.
+//#define GLCD_BENCHMARK
+
 // Set text size of display
 // These definitions are not currently used and will probably move to glcd.h
 #define GLCD_TEXT_LINES           8     // visible lines
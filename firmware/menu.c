@@ -0,0 +1,300 @@
+/* ***************************************************************************
+// menu.c - runs the settings menus from their tables
+// This code is distributed under the GNU Public License
+//		which can be found at http://www.gnu.org/licenses/gpl.txt
+//
+// The pages are described in PROGMEM (see MENUS in ratt.h), this is the
+// one button loop for all of them.  It draws the titles, labels, arrow
+// and instructions itself and leaves the values to each item's draw(),
+// redrawing only the row that changed.
+//
+// Changes to an item only count once SET goes past its last field: then
+// the fields with an eeprom slot are written and the item's save() runs.
+// Leaving it any other way, MENU or the timeout, puts its fields back as
+// they were when SET started editing it.
+**************************************************************************** */
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include "util.h"
+#include "ratt.h"
+#include "ks0108.h"
+#include "glcd.h"
+
+extern uint8_t just_pressed, pressed;
+extern uint8_t button_step;
+extern volatile uint8_t displaymode;
+
+// the page on the screen, a copy out of PROGMEM (no items if none is)
+static menu_t menu;
+static uint8_t menu_at;		// the item with the arrow
+static uint8_t menu_edit;	// how many SETs into the item we are, 0 if not editing
+static uint8_t menu_was[MENU_FIELDS];	// its fields when editing started
+
+// x+n, round from first again past last
+static uint8_t add_wrap(uint8_t x, uint8_t n, uint8_t first, uint8_t last) {
+  uint16_t i = x + n;
+
+  while (i > last)
+    i -= (uint16_t)last - first + 1;
+  return i;
+}
+
+// x+n in BCD, round from first again past last.  n is 1 or, for a held
+// '+', 10: one up in the tens unless that goes round.
+uint8_t bcd_add_wrap(uint8_t x, uint8_t n, uint8_t first, uint8_t last) {
+  if ((n == 10) && (x + 0x10 <= last))
+    return x + 0x10;
+  while (n--)
+    x = bcd_inc_wrap(x, first, last);
+  return x;
+}
+
+// only write the eeprom if it changes, it wears out
+void menu_ee_update(uint8_t addr, uint8_t v) {
+  if (eeprom_read_byte((uint8_t *)(uint16_t)addr) != v)
+    eeprom_write_byte((uint8_t *)(uint16_t)addr, v);
+}
+
+static void menu_item(uint8_t i, menu_item_t *it) {
+  memcpy_P(it, &menu.item[i], sizeof(*it));
+}
+
+// the field being edited, from 1
+static uint8_t menu_field(const menu_item_t *it) {
+  if (! menu_edit)
+    return 0;
+  if (it->order)
+    return it->order(menu_edit);
+  return menu_edit;
+}
+
+static void menu_value(const menu_item_t *it, uint8_t field) {
+  if (! it->draw)
+    return;
+  glcdSetAddress(it->x, it->row);
+  it->draw(field);
+}
+
+// every value on the page, the one being edited inverted
+static void menu_values(void) {
+  menu_item_t it;
+  uint8_t i;
+
+  for (i = 0; i < menu.items; i++) {
+    menu_item(i, &it);
+    menu_value(&it, (i == menu_at) ? menu_field(&it) : 0);
+  }
+}
+
+// one line of instructions, padded out over what was there
+static void menu_line(uint8_t row, const char *s_P) {
+  uint8_t n = 0;
+  char c;
+
+  glcdSetAddress(0, row);
+  while ((c = pgm_read_byte(s_P++))) {
+    glcdWriteChar(c, NORMAL);
+    n++;
+  }
+  while (n++ < GLCD_XPIXELS/6)
+    glcdWriteChar(' ', NORMAL);
+}
+
+static void menu_help(const menu_item_t *it) {
+  if (menu_edit) {
+    menu_line(6, PSTR("Press + to change"));
+    if (menu_edit < it->fields)
+      menu_line(7, PSTR("Press SET for next"));
+    else
+      menu_line(7, PSTR("Press SET to save"));
+  } else {
+    if (menu_at + 1 < menu.items)
+      menu_line(6, PSTR("Press MENU to advance"));
+    else
+      menu_line(6, PSTR("Press MENU to exit"));
+    menu_line(7, PSTR("Press SET to set"));
+  }
+}
+
+// the arrow goes next to the item, the items are on rows 1-5
+static void menu_arrow(const menu_item_t *it) {
+  glcdFillRectangle(0, 8, MENU_INDENT - 1, 40, OFF);
+  drawArrow(0, it->row*8 + 3, MENU_INDENT - 1);
+}
+
+// the whole page, only when it comes up
+static void menu_show(void) {
+  menu_item_t it;
+  uint8_t i;
+
+  glcdClearScreen();
+  glcdSetAddress((GLCD_XPIXELS - strlen_P(menu.title)*6) / 2, 0);
+  glcdPutStr_P(menu.title, NORMAL);
+  for (i = 0; i < menu.items; i++) {
+    menu_item(i, &it);
+    glcdSetAddress(MENU_INDENT, it.row);
+    glcdPutStr_P(it.label, NORMAL);
+  }
+  menu_values();
+  menu_item(menu_at, &it);
+  menu_arrow(&it);
+  menu_help(&it);
+}
+
+// SET on the item: load it, and keep its fields to go back to
+static void menu_start(const menu_item_t *it) {
+  menu_field_t f;
+  uint8_t i;
+
+  if (it->load)
+    it->load();
+  for (i = 0; i < it->fields; i++) {
+    memcpy_P(&f, &it->field[i], sizeof(f));
+    menu_was[i] = *f.value;
+  }
+  menu_edit = 1;
+}
+
+// SET after the last field: keep what the fields were changed to
+static void menu_save(const menu_item_t *it) {
+  menu_field_t f;
+  uint8_t i;
+
+  for (i = 0; i < it->fields; i++) {
+    memcpy_P(&f, &it->field[i], sizeof(f));
+    if (f.ee != MENU_NO_EE)
+      menu_ee_update(f.ee, (f.flags & MENU_BCD) ? bcd2i(*f.value) : *f.value);
+  }
+  menu_edit = 0;
+  if (it->save)
+    it->save();
+}
+
+// left in the middle of editing: put the fields back
+static void menu_cancel(const menu_item_t *it) {
+  menu_field_t f;
+  uint8_t i;
+
+  if (! menu_edit)
+    return;
+  for (i = 0; i < it->fields; i++) {
+    memcpy_P(&f, &it->field[i], sizeof(f));
+    *f.value = menu_was[i];
+  }
+  menu_edit = 0;
+  if (it->changed)
+    it->changed(0);
+  if (it->flags & MENU_REDRAW)
+    menu_values();
+}
+
+static void menu_plus(const menu_item_t *it) {
+  menu_field_t f;
+  uint8_t field = menu_field(it);
+  uint8_t n;
+
+  memcpy_P(&f, &it->field[field-1], sizeof(f));
+  n = f.step * button_step;
+  if (f.flags & MENU_BCD)
+    *f.value = bcd_add_wrap(*f.value, n, f.first, f.last);
+  else
+    *f.value = add_wrap(*f.value, n, f.first, f.last);
+  if (it->changed)
+    it->changed(field);
+
+  if (it->flags & MENU_REDRAW)
+    menu_values();
+  else
+    menu_value(it, field);
+}
+
+// Show the page and take the buttons until MENU goes past its last item,
+// or nothing was pressed for INACTIVITYTIMEOUT: then displaymode is
+// SHOW_TIME.  Pages run from an item's sub come back to the one they
+// were run from.
+void menu_run(const menu_t *page) {
+  menu_t up = menu;
+  uint8_t up_at = menu_at;
+  menu_item_t it;
+
+  memcpy_P(&menu, page, sizeof(menu));
+  menu_at = 0;
+  menu_edit = 0;
+  menu_item(0, &it);
+  displaymode = it.mode;
+  menu_show();
+
+  timer_start(TIMER_MENU, INACTIVITYTIMEOUT*1000UL, 0, 0);
+
+  while (1) {
+    glcdFlush();
+    timer_run();
+    event_poll();
+    if (just_pressed || pressed) {
+      timer_start(TIMER_MENU, INACTIVITYTIMEOUT*1000UL, 0, 0);
+    } else if (!timer_pending(TIMER_MENU)) {
+      //timed out!
+      menu_cancel(&it);
+      displaymode = SHOW_TIME;
+      break;
+    }
+
+    if (just_pressed & 0x1) {
+      just_pressed = 0;
+      menu_cancel(&it);
+      if (++menu_at == menu.items)
+	break;
+      menu_value(&it, 0);
+      menu_item(menu_at, &it);
+      displaymode = it.mode;
+      menu_arrow(&it);
+      menu_help(&it);
+    }
+
+    if (just_pressed & 0x2) {
+      just_pressed = 0;
+      if (! it.fields) {
+	if (it.sub) {
+	  menu_run(it.sub);
+	  if (displaymode == SHOW_TIME)
+	    break;
+	  displaymode = it.mode;
+	  menu_show();
+	}
+	continue;
+      }
+      if (! menu_edit)
+	menu_start(&it);
+      else if (menu_edit < it.fields)
+	menu_edit++;
+      else
+	menu_save(&it);
+      menu_value(&it, menu_field(&it));
+      menu_help(&it);
+    }
+
+    if (just_pressed & 0x4) {
+      just_pressed = 0;
+      if (menu_edit)
+	menu_plus(&it);
+    }
+  }
+
+  menu = up;
+  menu_at = up_at;
+  menu_edit = 0;
+}
+
+// the time changed: bring the values that follow it up to date
+void menu_clock(void) {
+  menu_item_t it;
+  uint8_t i;
+
+  for (i = 0; i < menu.items; i++) {
+    menu_item(i, &it);
+    if ((it.flags & MENU_LIVE) && !((i == menu_at) && menu_edit))
+      menu_value(&it, 0);
+  }
+}
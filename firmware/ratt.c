@@ -12,7 +12,6 @@
 #include <avr/eeprom.h>
 #include <avr/wdt.h>
 #include <string.h>
-#include <i2c.h>
 #include <stdlib.h>
 #include "util.h"
 #include "ratt.h"
@@ -20,19 +19,14 @@
 #include "glcd.h"
 
 
-volatile uint8_t time_s, time_m, time_h;
-volatile uint8_t old_h, old_m;
 volatile uint8_t timeunknown = 1;
-volatile uint8_t date_m, date_d, date_y;
 volatile uint8_t alarming, alarm_on, alarm_tripped, alarm_h, alarm_m;
 volatile uint8_t displaymode;
 volatile uint8_t volume;
 volatile uint8_t sleepmode = 0;
 volatile uint8_t region;
 volatile uint8_t time_format;
-extern volatile uint8_t screenmutex;
 volatile uint8_t minute_changed = 0, hour_changed = 0;
-volatile uint8_t score_mode_timeout = 0;
 volatile uint8_t score_mode = SCORE_MODE_TIME;
 volatile uint8_t last_score_mode;
 volatile uint8_t baseInverted = 0; //This is for a changeable screen inversion.
@@ -40,13 +34,7 @@ volatile uint8_t baseInverted = 0; //This is for a changeable screen inversion.
 // These store the current button states for all 3 buttons. We can 
 // then query whether the buttons are pressed and released or pressed
 // This allows for 'high speed incrementing' when setting the time
-extern volatile uint8_t last_buttonstate, just_pressed, pressed;
-extern volatile uint8_t buttonholdcounter;
-
-extern volatile uint8_t timeoutcounter;
-
-// How long we have been snoozing
-uint16_t snoozetimer = 0;
+extern uint8_t just_pressed, pressed;
 
 //Rules for autodst
 //they are an array of 9 values
@@ -58,37 +46,77 @@ SIGNAL(TIMER1_OVF_vect) {
   PIEZO_PORT ^= _BV(PIEZO);
 }
 
-volatile uint16_t millis = 0;
-volatile uint16_t animticker, alarmticker;
+// what the main loop tasks share
+uint8_t inverted;
+uint8_t display_date = 0;
+
+void task_buttons(void);
+void task_score(void);
+void task_draw(void);
+void task_minute(void);
+
+// the main loop's work, run by sched.c (see ratt.h)
+const task_t tasks[SCHED_TASKS] PROGMEM = {
+  { task_buttons, 0, 20 },			// TASK_BUTTONS
+  { task_score, 250, 250 },			// TASK_SCORE
+  { step, ANIMTICK_MS, ANIMTICK_MS },		// TASK_STEP
+  { task_draw, 0, ANIMTICK_MS },		// TASK_DRAW
+  { task_minute, 0, 1000 },			// TASK_MINUTE
+  { task_rtc, 0, 100 },				// TASK_RTC
+  { timer_run, 0, 2 },				// TASK_TIMER
+};
+
 SIGNAL(TIMER0_COMPA_vect) {
-  if (millis)
-    millis--;
-  if (animticker)
-    animticker--;
-
-  if (alarming && !snoozetimer) {
-    if (alarmticker == 0) {
-      alarmticker = 300;
-      if (TCCR1B == 0) {
-	TCCR1A = 0; 
-	TCCR1B =  _BV(WGM12) | _BV(CS10); // CTC with fastest timer
-	TIMSK1 = _BV(TOIE1) | _BV(OCIE1A);
-	OCR1A = (F_CPU / ALARM_FREQ) / 2;
-      } else {
-	TCCR1B = 0;
-	// turn off piezo
-	PIEZO_PORT &= ~_BV(PIEZO);
-      }
-    }
-    alarmticker--;    
+  wdt_reset();
+  timer_tick();
+  sched_tick();
+  rtc_ms();
+}
+
+// TIMER_ALARM: the alarm beeps ALARM_MSONOFF on, ALARM_MSONOFF off
+static void alarm_beep(void) {
+  if (TCCR1B == 0) {
+    TCCR1A = 0; 
+    TCCR1B =  _BV(WGM12) | _BV(CS10); // CTC with fastest timer
+    TIMSK1 = _BV(TOIE1) | _BV(OCIE1A);
+    OCR1A = (F_CPU / ALARM_FREQ) / 2;
+  } else {
+    TCCR1B = 0;
+    // turn off piezo
+    PIEZO_PORT &= ~_BV(PIEZO);
   }
 }
 
+// TIMER_SNOOZE: wake up again
+static void snooze_over(void) {
+  if (alarming)
+    timer_start(TIMER_ALARM, 1, ALARM_MSONOFF, alarm_beep);
+}
+
+// TIMER_SCORE: back to showing the time
+static void score_timeout(void) {
+  last_score_mode = score_mode;
+  score_mode = SCORE_MODE_TIME;
+  // the display still has the time from before any change
+  // that came in meanwhile, step() moves it on
+  setscore();
+}
+
+// a brightness saved when they went 0-BRIGHT_OLD_MAX, on the new scale
+static void rescale_bright(uint8_t addr) {
+  uint8_t b = eeprom_read_byte((uint8_t *)(uint16_t)addr);
+
+  if (b < BRIGHT_OLD_MAX)
+    eeprom_write_byte((uint8_t *)(uint16_t)addr, b * (BRIGHT_MAX + 1) / BRIGHT_OLD_MAX);
+  else if (b == BRIGHT_OLD_MAX)
+    eeprom_write_byte((uint8_t *)(uint16_t)addr, BRIGHT_MAX);
+}
+
 void init_eeprom(void) {	//Set eeprom to a default state.
   if(eeprom_read_byte((uint8_t *)EE_INIT) != EE_INITIALIZED) {
     eeprom_write_byte((uint8_t *)EE_ALARM_HOUR, 8);
     eeprom_write_byte((uint8_t *)EE_ALARM_MIN, 0);
-    eeprom_write_byte((uint8_t *)EE_BRIGHT, OCR2A_VALUE);
+    eeprom_write_byte((uint8_t *)EE_BRIGHT, BRIGHT_MAX);
     eeprom_write_byte((uint8_t *)EE_VOLUME, 1);
     eeprom_write_byte((uint8_t *)EE_REGION, REGION_US);
     eeprom_write_byte((uint8_t *)EE_TIME_FORMAT, TIME_12H);
@@ -97,19 +125,31 @@ void init_eeprom(void) {	//Set eeprom to a default state.
     #ifdef AUTODIM_EEPROM
     eeprom_write_word((uint16_t *)EE_AUTODIM_DAY_TIME, 360);
     eeprom_write_word((uint16_t *)EE_AUTODIM_NIGHT_TIME, 1380);
-    eeprom_write_byte((uint8_t *)EE_AUTODIM_DAY_BRIGHT, 11);
-    eeprom_write_byte((uint8_t *)EE_AUTODIM_NIGHT_BRIGHT, 1);
+    eeprom_write_byte((uint8_t *)EE_AUTODIM_DAY_BRIGHT, 176);
+    eeprom_write_byte((uint8_t *)EE_AUTODIM_NIGHT_BRIGHT, 16);
     #endif
     #ifdef AUTODST
     eeprom_write_byte((uint8_t *)EE_AUTODST, 0);
     #endif //#ifdef AUTODST
+    eeprom_write_byte((uint8_t *)EE_BRIGHT_SCALE, EE_INITIALIZED);
+  }
+
+  // older firmware saved the brightnesses 0-BRIGHT_OLD_MAX, they would
+  // come up nearly dark now
+  if(eeprom_read_byte((uint8_t *)EE_BRIGHT_SCALE) != EE_INITIALIZED) {
+    rescale_bright(EE_BRIGHT);
+    #ifdef AUTODIM_EEPROM
+    rescale_bright(EE_AUTODIM_DAY_BRIGHT);
+    rescale_bright(EE_AUTODIM_NIGHT_BRIGHT);
+    #endif
+    eeprom_write_byte((uint8_t *)EE_BRIGHT_SCALE, EE_INITIALIZED);
   }
 }
 
 int main(void) {
-  uint8_t inverted = baseInverted;
   uint8_t mcustate;
-  uint8_t display_date = 0;
+
+  inverted = baseInverted;
 
   // check if we were reset
   mcustate = MCUSR;
@@ -146,6 +186,10 @@ int main(void) {
   TCCR0B = _BV(CS01) | _BV(CS00);
   OCR0A = 125;
   TIMSK0 |= _BV(OCIE0A);
+#ifdef GLCD_ASYNC_FLUSH
+  // the background display flush runs off compare B, half way between ticks
+  OCR0B = 62;
+#endif
 
   // turn backlight on
   DDRD |= _BV(3);
@@ -153,9 +197,8 @@ int main(void) {
   PORTD |= _BV(3);
 #else
   TCCR2A = _BV(COM2B1); // PWM output on pin D3
-  TCCR2A |= _BV(WGM21) | _BV(WGM20); // fast PWM
-  TCCR2B |= _BV(WGM22);
-  OCR2A = OCR2A_VALUE;
+  TCCR2A |= _BV(WGM21) | _BV(WGM20); // fast PWM, 0 to 0xFF
+  TCCR2B = _BV(CS21); // div by 8, 3.9KHz
   OCR2B = eeprom_read_byte((uint8_t *)EE_BRIGHT);
 #endif
 
@@ -168,8 +211,15 @@ int main(void) {
   //using a watch dog timer.  The lcd should initialized in way less than 500 ms.
   wdt_enable(WDTO_2S);
   glcdInit();
+#ifdef GLCD_BENCHMARK
+  glcdBenchmark();
+#endif
   glcdClearScreen();
 
+  #ifdef BUTTON_CALIBRATE
+  button_calibrate();
+  #endif
+
   #ifdef AUTODIM_EEPROM
   init_autodim_eeprom();
   #endif
@@ -181,11 +231,19 @@ int main(void) {
   initanim();
   initdisplay(inverted);
 
+  // everything from here on happens in the tasks
   while (1) {
-    animticker = ANIMTICK_MS;
-    
+    sched_run();
+    //uart_getchar();  // you would uncomment this so you can manually 'step'
+  }
+
+  halt();
+}
+
+// once a minute (and at startup)
+void task_minute(void) {
    #ifdef AUTODIM
-      autoDim(time_h, time_m);
+      autoDimNow();
    #endif
    
     //check daylight savings time
@@ -194,31 +252,30 @@ int main(void) {
       autodst(rule);
     #endif //#ifdef AUTODST
 
-    // check buttons to see if we have interaction stuff to deal with
-	if(just_pressed && alarming)
-	{
-	  just_pressed = 0;
-	  setsnooze();
-	}
-	if(display_date==1 && !score_mode_timeout)
+    DEBUG(sched_report());
+}
+
+// show the date/year one after the other after '+' was pressed
+void task_score(void) {
+	if(display_date==1 && !timer_pending(TIMER_SCORE))
 	{
 		display_date=3;
 		score_mode = SCORE_MODE_DATELONG;
-	    score_mode_timeout = 3;
+	    timer_start(TIMER_SCORE, SCORE_TIMEOUT*1000UL, 0, score_timeout);
 	    setscore();
 	}
-	else if(display_date==2 && !score_mode_timeout)
+	else if(display_date==2 && !timer_pending(TIMER_SCORE))
 	{
 		display_date=3;
 		score_mode = SCORE_MODE_DATE;
-	    score_mode_timeout = 3;
+	    timer_start(TIMER_SCORE, SCORE_TIMEOUT*1000UL, 0, score_timeout);
 	    setscore();
 	}
-	else if(display_date==3 && !score_mode_timeout)
+	else if(display_date==3 && !timer_pending(TIMER_SCORE))
 	{
 		display_date=0;
 		score_mode = SCORE_MODE_YEAR;
-	    score_mode_timeout = 3;
+	    timer_start(TIMER_SCORE, SCORE_TIMEOUT*1000UL, 0, score_timeout);
 	    setscore();
 	}
 	/*if(display_date && !score_mode_timeout)
@@ -252,6 +309,17 @@ int main(void) {
 	  setscore();
 	  display_date = 0;
 	}*/
+}
+
+// check buttons to see if we have interaction stuff to deal with
+void task_buttons(void) {
+	event_poll();
+
+	if(just_pressed && alarming)
+	{
+	  just_pressed = 0;
+	  setsnooze();
+	}
 
     //Was formally set for just the + button.  However, because the Set button was never
     //accounted for, If the alarm was turned on, and ONLY the set button was pushed since then,
@@ -275,7 +343,7 @@ int main(void) {
 	  	display_date = 1;
 	  	score_mode = SCORE_MODE_DOW;
 	  }
-	  score_mode_timeout = 3;
+	  timer_start(TIMER_SCORE, SCORE_TIMEOUT*1000UL, 0, score_timeout);
 	  setscore();
 	}
 
@@ -283,51 +351,31 @@ int main(void) {
       just_pressed = 0;
       display_date = 0;
       score_mode = SCORE_MODE_TIME;
-      score_mode_timeout = 0;
+      timer_stop(TIMER_SCORE);
       setscore();
-      switch(displaymode) {
-      case (SHOW_TIME):
-	displaymode = SET_ALARM;
-	set_alarm();
-	break;
-      case (SET_ALARM):
-	displaymode = SET_TIME;
-	set_time();
-	timeunknown = 0;
-	break;
-      case SET_TIME:
-	displaymode = SET_DATE;
-	set_date();
-	break;
-      case SET_DATE:
-	displaymode = SET_REGION;
-	set_region();
-	break;
-#ifdef BACKLIGHT_ADJUST
-	  case SET_REGION:
-	displaymode = SET_BRIGHTNESS;
-	set_backlight();
-	break;
-#endif
-      default:
-	displaymode = SHOW_TIME;
-	glcdClearScreen();
-	initdisplay(inverted);
-      }
-
-      if (displaymode == SHOW_TIME) {
-	glcdClearScreen();
-	initdisplay(inverted);
-      }
+      menu_run(&config_menu);
+      displaymode = SHOW_TIME;
+      glcdClearScreen();
+      initdisplay(inverted);
+      glcdFlushAsync();
     }
 
-    step();
+    // sched_ready() only remembers one run, go round again for the rest
+    if (just_pressed || event_waiting())
+      sched_ready(TASK_BUTTONS);
+}
+
+// bring the screen up to date, made ready by step() and every second by the rtc
+void task_draw(void) {
+    datetime_t now;
+
     if (displaymode == SHOW_TIME) {
-      if ((inverted == baseInverted) && alarming && (time_s & 0x1)) {
+      get_time_snapshot(&now);
+      if ((inverted == baseInverted) && alarming && (now.s & 0x1)) {
 	inverted = !baseInverted;
 	initdisplay(inverted);
       }
-      else if (((inverted == !baseInverted) && ! alarming) || (alarming && (inverted == !baseInverted) && !(time_s & 0x1))) {
+      else if (((inverted == !baseInverted) && ! alarming) || (alarming && (inverted == !baseInverted) && !(now.s & 0x1))) {
 	inverted = baseInverted;
 	initdisplay(inverted);
       } else {
@@ -336,12 +384,10 @@ int main(void) {
 	PORTB &= ~_BV(5);
     }
   }
-  
-    while (animticker);
-    //uart_getchar();  // you would uncomment this so you can manually 'step'
-  }
 
-  halt();
+    // send whatever was drawn to the display, it goes out
+    // in the background while the other tasks run
+    glcdFlushAsync();
 }
 
 
@@ -370,12 +416,13 @@ void setalarmstate(void) {
       // turn off the alarm
       alarm_on = 0;
       alarm_tripped = 0;
-      snoozetimer = 0;
+      timer_stop(TIMER_SNOOZE);
       if (alarming) {
 	// if the alarm is going off, we should turn it off
 	// and quiet the speaker
 	DEBUGP("alarm off");
 	alarming = 0;
+	timer_stop(TIMER_ALARM);
 	TCCR1B = 0;
 	// turn off piezo
 	PIEZO_PORT &= ~_BV(PIEZO);
@@ -387,9 +434,9 @@ void setalarmstate(void) {
       // alarm on!
       alarm_on = 1;
       // reset snoozing
-      snoozetimer = 0;
+      timer_stop(TIMER_SNOOZE);
 	  score_mode = SCORE_MODE_ALARM;
-	  score_mode_timeout = 3;
+	  timer_start(TIMER_SCORE, SCORE_TIMEOUT*1000UL, 0, score_timeout);
 	  setscore();
       DEBUGP("alarm on");
     }   
@@ -411,174 +458,60 @@ void printnumber(uint8_t n, uint8_t inverted) {
   glcdWriteChar(n%10+'0', inverted);
 }
 
-uint8_t readi2ctime(void) {
-  uint8_t regaddr = 0, r;
-  uint8_t clockdata[8];
-  
-  // check the time from the RTC
-  cli();
-  r = i2cMasterSendNI(0xD0, 1, &regaddr);
-
-  if (r != 0) {
-    DEBUG(putstring("Reading i2c data: ")); DEBUG(uart_putw_dec(r)); DEBUG(putstring_nl(""));
-    while(1) {
-      sei();
-      beep(4000, 100);
-      _delay_ms(100);
-      beep(4000, 100);
-      _delay_ms(1000);
-    }
-  }
-
-  r = i2cMasterReceiveNI(0xD0, 7, &clockdata[0]);
-  sei();
-
-  if (r != 0) {
-    DEBUG(putstring("Reading i2c data: ")); DEBUG(uart_putw_dec(r)); DEBUG(putstring_nl(""));
-    while(1) {
-      beep(4000, 100);
-      _delay_ms(100);
-      beep(4000, 100);
-      _delay_ms(1000);
-    }
-  }
-
-  time_s = ((clockdata[0] >> 4) & 0x7)*10 + (clockdata[0] & 0xF);
-  time_m = ((clockdata[1] >> 4) & 0x7)*10 + (clockdata[1] & 0xF);
-  if (clockdata[2] & _BV(6)) {
-    // "12 hr" mode
-    time_h = ((clockdata[2] >> 5) & 0x1)*12 + 
-      ((clockdata[2] >> 4) & 0x1)*10 + (clockdata[2] & 0xF);
-  } else {
-    time_h = ((clockdata[2] >> 4) & 0x3)*10 + (clockdata[2] & 0xF);
-  }
-  
-  date_d = ((clockdata[4] >> 4) & 0x3)*10 + (clockdata[4] & 0xF);
-  date_m = ((clockdata[5] >> 4) & 0x1)*10 + (clockdata[5] & 0xF);
-  date_y = ((clockdata[6] >> 4) & 0xF)*10 + (clockdata[6] & 0xF);
-
-  return clockdata[0] & 0x80;
+// two BCD digits, as the time and date are kept
+void printbcd(uint8_t n, uint8_t inverted) {
+  glcdWriteChar((n >> 4)+'0', inverted);
+  glcdWriteChar((n & 0xF)+'0', inverted);
 }
 
-void writei2ctime(uint8_t sec, uint8_t min, uint8_t hr, uint8_t day,
-		  uint8_t date, uint8_t mon, uint8_t yr) {
-  uint8_t clockdata[8] = {0,0,0,0,0,0,0,0};
-
-  clockdata[0] = 0; // address
-  clockdata[1] = i2bcd(sec);  // s
-  clockdata[2] = i2bcd(min);  // m
-  clockdata[3] = i2bcd(hr); // h
-  clockdata[4] = i2bcd(day);  // day
-  clockdata[5] = i2bcd(date);  // date
-  clockdata[6] = i2bcd(mon);  // month
-  clockdata[7] = i2bcd(yr); // year
-  
-  cli();
-  uint8_t r = i2cMasterSendNI(0xD0, 8, &clockdata[0]);
-  sei();
-
-  //DEBUG(putstring("Writing i2c data: ")); DEBUG(uart_putw_dec()); DEBUG(putstring_nl(""));
-
-  if (r != 0) {
-    while(1) {
-      beep(4000, 100);
-      _delay_ms(100);
-      beep(4000, 100);
-      _delay_ms(1000);
-    }
-  }
-
+// three digits, for the backlight
+void printnumber3(uint8_t n, uint8_t inverted) {
+  glcdWriteChar(n/100+'0', inverted);
+  printnumber(n%100, inverted);
 }
 
-// runs at about 30 hz
-uint8_t t2divider1 = 0, t2divider2 = 0;
-SIGNAL (TIMER2_OVF_vect) {
-  wdt_reset();
-#ifdef BACKLIGHT_ADJUST
-  if (t2divider1 == TIMER2_RETURN) {
-#else
-  if (t2divider1 == 5) {
-#endif
-    t2divider1 = 0;
-  } else {
-    t2divider1++;
-    return;
-  }
-
-  //This occurs at 6 Hz
+// the time as clock_check() saw it last time round
+uint8_t seen_s, seen_m, seen_h;
 
-  uint8_t last_s = time_s;
-  uint8_t last_m = time_m;
-  uint8_t last_h = time_h;
+// what changed since last time: on an EVENT_TICK, and after every poll
+// in case the queue was full
+void clock_check(void) {
+  uint8_t last_s = seen_s;
+  uint8_t last_m = seen_m;
+  uint8_t last_h = seen_h;
+  datetime_t now;
 
-  readi2ctime();
+  get_time_snapshot(&now);
   
-  if (time_h != last_h) {
+  if (now.h != last_h) {
     hour_changed = 1; 
-    old_h = last_h;
-    old_m = last_m;
-  } else if (time_m != last_m) {
+    sched_ready(TASK_MINUTE);
+  } else if (now.m != last_m) {
     minute_changed = 1;
-    old_m = last_m;
+    sched_ready(TASK_MINUTE);
   }
 
-  if (time_s != last_s) {
-    if(alarming && snoozetimer)
-	  snoozetimer--;
-
-    if(score_mode_timeout) {
-	  score_mode_timeout--;
-	  if(!score_mode_timeout) {
-	  	last_score_mode = score_mode;
-	    score_mode = SCORE_MODE_TIME;
-	    if(hour_changed) {
-	      time_h = old_h;
-	      time_m = old_m;
-	    } else if (minute_changed) {
-	      time_m = old_m;
-	    }
-	    setscore();
-	    if(hour_changed || minute_changed) {
-	      time_h = last_h;
-	      time_m = last_m;
-	    }
-	  }
-	}
+  if (now.s != last_s) {
+    // the alarm blinks the screen with the seconds
+    sched_ready(TASK_DRAW);
 
 
     DEBUG(putstring("**** "));
-    DEBUG(uart_putw_dec(time_h));
+    DEBUG(uart_putc_hex(now.h));
     DEBUG(uart_putchar(':'));
-    DEBUG(uart_putw_dec(time_m));
+    DEBUG(uart_putc_hex(now.m));
     DEBUG(uart_putchar(':'));
-    DEBUG(uart_putw_dec(time_s));
+    DEBUG(uart_putc_hex(now.s));
     DEBUG(putstring_nl("****"));
   }
 
-  if (((displaymode == SET_ALARM) ||
-       (displaymode == SET_DATE) ||
-       (displaymode == SET_REGION) ||
-       (displaymode == SET_BRIGHTNESS)) &&
-      (!screenmutex) ) {
-      glcdSetAddress(MENU_INDENT + 10*6, 2);
-      print_timehour(time_h, NORMAL);
-      glcdWriteChar(':', NORMAL);
-      printnumber(time_m, NORMAL);
-      glcdWriteChar(':', NORMAL);
-      printnumber(time_s, NORMAL);
-
-      if (time_format == TIME_12H) {
-	glcdWriteChar(' ', NORMAL);
-	if (time_h >= 12) {
-	  glcdWriteChar('P', NORMAL);
-	} else {
-	  glcdWriteChar('A', NORMAL);
-	}
-      }
-  }
+  // the menus show the time too
+  menu_clock();
 
-  // check if we have an alarm set
-  if (alarm_on && (time_s == 0) && (time_m == alarm_m) && (time_h == alarm_h)) {
+  // check if we have an alarm set, and it just turned that minute (we
+  // may not get to see second 0 while the main loop is kept busy)
+  if (alarm_on && ((now.m != last_m) || (now.h != last_h)) &&
+      (now.m == alarm_m) && (now.h == alarm_h)) {
     DEBUG(putstring_nl("ALARM TRIPPED!!!"));
     alarm_tripped = 1;
   }
@@ -588,86 +521,61 @@ SIGNAL (TIMER2_OVF_vect) {
   	 DEBUG(putstring_nl("ALARM GOING!!!!"));
   	 alarming = 1;
   	 alarm_tripped = 0;
+  	 timer_start(TIMER_ALARM, 1, ALARM_MSONOFF, alarm_beep);
   }
 
-  if (t2divider2 == 6) {
-    t2divider2 = 0;
-  } else {
-    t2divider2++;
-    return;
-  }
-
-  if (buttonholdcounter) {
-    buttonholdcounter--;
-  }
-
-  if (timeoutcounter) {
-    timeoutcounter--;
-  }
-}
-
-uint8_t leapyear(uint16_t y) {
-  return ( (!(y % 4) && (y % 100)) || !(y % 400));
-}
-
-void tick(void) {
-
-
+  seen_s = now.s;
+  seen_m = now.m;
+  seen_h = now.h;
 }
 
-
-
-inline uint8_t i2bcd(uint8_t x) {
-  return ((x/10)<<4) | (x%10);
+// TIMER_CLOCK, every CLOCK_POLL_MS (in the main loop, or a menu's)
+static void clock_poll(void) {
+  // the time changes once a read is in, we see that next time round
+  rtc_poll();
+  clock_check();
 }
 
-
 void clock_init(void) {
-  // talk to clock
-  i2cInit();
-
-
-  if (readi2ctime()) {
-    DEBUGP("uh oh, RTC was off, lets reset it!");
-    writei2ctime(0, 0, 12, 0, 1, 1, 9); // noon 1/1/2009
-   }
+  datetime_t now;
 
-  readi2ctime();
+  // talk to clock
+  rtc_init();
+  get_time_snapshot(&now);
+  seen_s = now.s;
+  seen_m = now.m;
+  seen_h = now.h;
 
   DEBUG(putstring("\n\rread "));
-  DEBUG(uart_putw_dec(time_h));
+  DEBUG(uart_putc_hex(now.h));
   DEBUG(uart_putchar(':'));
-  DEBUG(uart_putw_dec(time_m));
+  DEBUG(uart_putc_hex(now.m));
   DEBUG(uart_putchar(':'));
-  DEBUG(uart_putw_dec(time_s));
+  DEBUG(uart_putc_hex(now.s));
 
   DEBUG(uart_putchar('\t'));
-  DEBUG(uart_putw_dec(date_d));
+  DEBUG(uart_putc_hex(now.d));
   DEBUG(uart_putchar('/'));
-  DEBUG(uart_putw_dec(date_m));
+  DEBUG(uart_putc_hex(now.mo));
   DEBUG(uart_putchar('/'));
-  DEBUG(uart_putw_dec(date_y));
+  DEBUG(uart_putc_hex(now.y));
   DEBUG(putstring_nl(""));
 
-  alarm_m = eeprom_read_byte((uint8_t *)EE_ALARM_MIN) % 60;
-  alarm_h = eeprom_read_byte((uint8_t *)EE_ALARM_HOUR) % 24;
-
-
-  //ASSR |= _BV(AS2); // use crystal
+  // the eeprom has the alarm in binary
+  alarm_m = i2bcd(eeprom_read_byte((uint8_t *)EE_ALARM_MIN) % 60);
+  alarm_h = i2bcd(eeprom_read_byte((uint8_t *)EE_ALARM_HOUR) % 24);
 
-  TCCR2B = _BV(CS22) | _BV(CS21) | _BV(CS20); // div by 1024
-  // overflow ~30Hz = 8MHz/(255 * 1024)
 
-  // enable interrupt
-  TIMSK2 = _BV(TOIE2);
+  // looks at the time from now on, once timer0 runs
+  timer_start(TIMER_CLOCK, CLOCK_POLL_MS, CLOCK_POLL_MS, clock_poll);
 
   sei();
 }
 
 void setsnooze(void) {
-  //snoozetimer = eeprom_read_byte((uint8_t *)EE_SNOOZE);
-  //snoozetimer *= 60; // convert minutes to seconds
-  snoozetimer = MAXSNOOZE;
+  //timer_start(TIMER_SNOOZE, eeprom_read_byte((uint8_t *)EE_SNOOZE) * 60000UL, 0, snooze_over);
+  timer_stop(TIMER_ALARM);
+  timer_start(TIMER_SNOOZE, MAXSNOOZE*1000UL, 0, snooze_over);
   TCCR1B = 0;
   // turn off piezo
   PIEZO_PORT &= ~_BV(PIEZO);
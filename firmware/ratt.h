@@ -25,6 +25,23 @@
 //AutoDST automatically changes your clock's time for DST. Uncomment to enable.
 //#define AUTODST
 
+//RTC_SQW counts the seconds from the RTC's 1Hz square wave (DS1307 pin 7, SQW/OUT,
+//wired to the SQW pin below) instead of reading the time over i2c 6 times a second.
+//The time is only read back once a minute to stay in sync.  If the square wave
+//never shows up, or stops, the clock goes back to reading the time 6 times a second.
+//Needs a hardware mod: the stock board leaves SQW/OUT unconnected, run a wire from
+//it to PC1 (and nothing else on PC1) before you uncomment this.
+//#define RTC_SQW
+#ifdef RTC_SQW
+//How many 6Hz clock_poll()s without an edge before we give up on the square wave.
+#define SQW_TIMEOUT 12
+#endif
+
+//BUTTON_CALIBRATE has you hold each button once, when one is held down at power up,
+//and keeps where they sit on the resistor ladder in the eeprom, instead of trusting
+//BUTTON_*_ADC below.  Uncomment to enable.
+//#define BUTTON_CALIBRATE
+
 // how fast to proceed the animation, note that the redrawing
 // takes some time too so you dont want this too small or itll
 // 'hiccup' and appear jittery
@@ -36,6 +53,9 @@
  
 #define MAXSNOOZE 600 // 10 minutes
 
+// how many seconds the date/alarm stays up after '+' or the alarm switch
+#define SCORE_TIMEOUT 3
+
 // how many seconds we will wait before turning off menus
 #define INACTIVITYTIMEOUT 10 
 
@@ -46,6 +66,59 @@
 //Set button is 0x2
 //+ button is 0x3
 //Multiple buttons can be watched for by setting combinations of bits, i.e. 0x4 which is + and menu button.
+
+//The buttons share ADC2 through a resistor ladder: above BUTTON_NONE_ADC
+//nothing is pressed, then down the ladder '+', SET and MENU.
+//(BUTTON_CALIBRATE replaces these with what it measured.)
+#define BUTTON_NONE_ADC 735
+#define BUTTON_PLUS_ADC 610
+#define BUTTON_SET_ADC 270
+//Each ms the last BUTTON_OVERSAMPLE conversions (a power of 2) are averaged.
+//If they are more than BUTTON_NOISE apart the ladder is moving and the
+//reading is thrown away.
+#define BUTTON_OVERSAMPLE 4
+#define BUTTON_NOISE 24
+//Readings in a row that have to agree before a button is taken as down,
+//or up again
+#define BUTTON_DEBOUNCE 4
+#ifdef BUTTON_CALIBRATE
+//ms calibration waits for each button, and how far below the one above
+//a button has to sit to be told apart from it
+#define BUTTON_CAL_MS 15000
+#define BUTTON_CAL_GAP 40
+#endif
+//ms a button is held for a long press
+#define BUTTON_LONG_MS 2000
+//A held button repeats after BUTTON_REPEAT_MS, then every BUTTON_REPEAT_SLOW_MS
+//(5 a second), every BUTTON_REPEAT_FAST_MS (20 a second) once it has been held
+//for BUTTON_FAST_MS, and slowly again once it has been held for BUTTON_STEP10_MS,
+//when the menus move their values 10 at a time (see button_step)
+#define BUTTON_REPEAT_MS 500
+#define BUTTON_REPEAT_SLOW_MS 200
+#define BUTTON_REPEAT_FAST_MS 50
+#define BUTTON_FAST_MS 2000
+#define BUTTON_STEP10_MS 4000
+//The buttons whose repeats count as presses in the menus: '+'
+#define BUTTON_REPEATS 0x4
+//What buttons.c makes of them
+#define BUTTON_PRESS 0
+#define BUTTON_RELEASE 1
+#define BUTTON_LONG 2
+#define BUTTON_REPEAT 3
+
+/*************************** EVENTS */
+
+// What the interrupts tell the main loop goes through the queue in
+// event.c, in the order it happened.  The button events above are event
+// types too, with the button's bit in data.
+#define EVENT_ALARMSW 4	// the alarm switch moved
+#define EVENT_TICK 5	// the time changed, data is the new second
+
+typedef struct {
+  uint8_t type;
+  uint8_t data;
+  uint16_t ms;		// the low 16 bits of the uptime it happened at
+} event_t;
 /*************************** DISPLAY PARAMETERS */
 
 // how many pixels to indent the menu items
@@ -57,6 +130,8 @@
 #define DISPLAY_H1_X 45
 #define DISPLAY_M10_X 70
 #define DISPLAY_M1_X 85
+// and the colon, half way between the hours and the minutes
+#define DISPLAY_COLON_X 62
 
 #define DISPLAY_DOW1_X 35
 #define DISPLAY_DOW2_X 50
@@ -76,6 +151,10 @@
 #define DISPLAY_DIGITW 10
 #define DISPLAY_DIGITH 16
 
+// how many times BigFont is blown up for the big time digits (2-6),
+// each digit is 4x this wide and 8x this high
+#define DISPLAY_DIGITSCALE 3
+
 
 /* not used
 #define ALARMBOX_X 20
@@ -97,6 +176,15 @@
 #define PIEZO_DDR DDRC
 #define PIEZO 3
 
+// the RTC's square wave output is open drain, so the pullup is used
+#define SQW_DDR DDRC
+#define SQW_PIN PINC
+#define SQW_PORT PORTC
+#define SQW 1
+#define SQW_PCMSK PCMSK1
+#define SQW_PCIE PCIE1
+#define SQW_vect PCINT1_vect
+
 
 /*************************** ENUMS */
 
@@ -120,14 +208,18 @@
 #define TIME_12H 0
 #define TIME_24H 1
 
-//Contstants for calcualting the Timer2 interrupt return rate.
-//Desired rate, is to have the i2ctime read out about 6 times
-//a second, and a few other values about once a second.
-#define OCR2B_BITSHIFT 0
-#define OCR2B_PLUS 1
-#define OCR2A_VALUE 16
-#define TIMER2_RETURN 80
-//#define TIMER2_RETURN (8000000 / (OCR2A_VALUE * 1024 * 6))
+//The RTC is read, and the time looked at, about 6 times a second by
+//clock_poll(), off a timer (see timer.c) so timer2 is free for the backlight.
+#define CLOCK_POLL_MS 167
+
+//The backlight is timer2's fast PWM on OC2B at 8MHz/8/256 = 3.9KHz, too fast to
+//flicker, with all 8 bits of OCR2B for the brightness.  '+' steps it by
+//BRIGHT_STEP, from BRIGHT_MAX it wraps round to off.
+#define BRIGHT_MAX 255
+#define BRIGHT_STEP 1
+//Older firmware, with timer2 also the clock, had the brightness go 0-16.  init_eeprom()
+//moves what it saved up to 0-BRIGHT_MAX the first time round (see EE_BRIGHT_SCALE).
+#define BRIGHT_OLD_MAX 16
 
 // displaymode
 #define NONE 99
@@ -143,18 +235,6 @@
 #define SHOW_SNOOZE 9
 #define SET_SNOOZE 10
 
-#define SET_MONTH 11
-#define SET_DAY 12
-#define SET_YEAR 13
-
-#define SET_HOUR 101
-#define SET_MIN 102
-#define SET_SEC 103
-
-#define SET_REG 104
-
-#define SET_BRT 105
-
 //DO NOT set EE_INITIALIZED to 0xFF / 255,  as that is
 //the state the eeprom will be in, when totally erased.
 #define EE_INITIALIZED 0xC3
@@ -175,12 +255,156 @@
 #ifdef AUTODST
 #define EE_AUTODST 14
 #endif // #ifdef AUTODST
+#ifdef BUTTON_CALIBRATE
+#define EE_BUTTON_CAL 15 //EE_INITIALIZED once the buttons are calibrated
+#define EE_BUTTON_ADC 16 //Note this is 3 words, the NONE, PLUS and SET thresholds.
+#endif
+#define EE_BRIGHT_SCALE 22 //EE_INITIALIZED once the brightnesses are 0-BRIGHT_MAX
+
+/*************************** BCD */
+
+// The time, date and alarm (time_s/m/h, date_d/m/y, alarm_h/m) are kept in
+// packed BCD, the way the DS1307 counts: 0x59 is 59.  A digit is a nibble,
+// so showing them takes no division, and BCD values still compare like the
+// numbers they stand for.
+
+// x+1
+static inline uint8_t bcd_inc(uint8_t x) {
+  x++;
+  if ((x & 0xF) == 0xA)
+    x += 6;
+  return x;
+}
+
+// x-1, x is not 0
+static inline uint8_t bcd_dec(uint8_t x) {
+  if ((x & 0xF) == 0)
+    x -= 6;
+  return x - 1;
+}
+
+// x+1, or first again after last
+static inline uint8_t bcd_inc_wrap(uint8_t x, uint8_t first, uint8_t last) {
+  return (x >= last) ? first : bcd_inc(x);
+}
+
+// to binary, for the date arithmetic
+static inline uint8_t bcd2i(uint8_t x) {
+  return (x >> 4)*10 + (x & 0xF);
+}
+
+// hour 0x00-0x23 on the 12 hour clock, 0x01-0x12
+static inline uint8_t bcd_hour12(uint8_t h) {
+  if (h == 0)
+    return 0x12;
+  if (h > 0x12) {
+    h -= 0x12;
+    if ((h & 0xF) > 9)
+      h -= 6;
+  }
+  return h;
+}
+
+/*************************** CLOCK */
+
+// the time and date, in BCD.  rtc.c keeps it the way the RTC (or timer0,
+// or the square wave) counts it, changed from interrupts; the rest of the
+// code takes a whole copy with get_time_snapshot() instead of reading it
+// a byte at a time while it may be changing.
+typedef struct {
+  uint8_t s, m, h;
+  uint8_t d, mo, y;
+} datetime_t;
+
+/*************************** TASKS */
+
+// The main loop's work is split into tasks that sched.c runs when
+// they are ready: either their period ran out or an interrupt (or
+// another task) called sched_ready() because their inputs changed.
+// The number is the task's bit in the ready mask, so 8 at most.
+#define TASK_BUTTONS 0	// an input event is queued
+#define TASK_SCORE 1	// step through date/year after '+'
+#define TASK_STEP 2	// advance the animation
+#define TASK_DRAW 3	// something on the screen needs drawing
+#define TASK_MINUTE 4	// autodim and autodst, when the minute changes
+#define TASK_RTC 5	// read the time back from the RTC
+#define TASK_TIMER 6	// a timer ran out, see timer.c
+#define SCHED_TASKS 7
+
+typedef struct {
+  void (*run)(void);
+  uint16_t period;	// ms between runs, 0 if it only runs when made ready
+  uint16_t deadline;	// ms it may wait once ready, the nearest deadline goes first
+} task_t;
+
+/*************************** TIMERS */
+
+// Software timers off the 1ms uptime (timer.c), started with timer_start()
+// and run out in the main loop.  The number is the timer's bit in a mask,
+// so 8 at most.
+#define TIMER_ALARM 0	// beeps the alarm on and off
+#define TIMER_SNOOZE 1	// snoozing
+#define TIMER_SCORE 2	// back to the time after the date or alarm was shown
+#define TIMER_MENU 3	// the menu times out with no buttons pressed
+#define TIMER_CLOCK 4	// clock_poll()
+#define TIMERS 5
+
+/*************************** MENUS */
+
+// The settings menus are tables in PROGMEM that menu.c runs (config.c
+// and AdvancedFeatures.c have theirs).  A page (menu_t) is a title and
+// an item a row (menu_item_t).  MENU moves the arrow down the items, SET
+// edits an item's fields (menu_field_t) one after the other and '+'
+// steps the one shown inverted.
+#define MENU_NO_EE 0xFF	// the field isn't kept in the eeprom
+#define MENU_FIELDS 3	// the most fields an item has
+
+// menu_field_t flags
+#define MENU_BCD 0x1	// value, first and last are BCD (the eeprom keeps it binary)
+
+// menu_item_t flags
+#define MENU_LIVE 0x1	// menu_clock() redraws it while it isn't being edited
+#define MENU_REDRAW 0x2	// '+' on it changes how the other items are drawn
+
+typedef struct {
+  volatile uint8_t *value;
+  uint8_t first, last;	// '+' goes round from last to first
+  uint8_t step;		// how far '+' moves it (times button_step)
+  uint8_t flags;
+  uint8_t ee;		// where it is saved once it has been edited, or MENU_NO_EE
+} menu_field_t;
+
+typedef struct menu_s menu_t;
+
+typedef struct {
+  const char *label;		// in PROGMEM
+  uint8_t row, x;		// the text line, and the pixel the value starts at
+  uint8_t mode;			// displaymode while the arrow is on it
+  uint8_t flags;
+  uint8_t fields;
+  const menu_field_t *field;	// fields of them, in PROGMEM
+  void (*draw)(uint8_t field);	// the value at the address, field (from 1) inverted or 0
+  uint8_t (*order)(uint8_t n);	// the field SET goes to n'th, 0 for the order they are in
+  void (*load)(void);		// SET, before the first field
+  void (*changed)(uint8_t field);	// '+' changed field, 0 if they were all put back
+  void (*save)(void);		// SET after the last field
+  const menu_t *sub;		// SET runs this page instead, if there are no fields
+} menu_item_t;
+
+struct menu_s {
+  const char *title;		// in PROGMEM
+  uint8_t items;
+  const menu_item_t *item;	// in PROGMEM
+};
 
 /*************************** FUNCTION PROTOTYPES */
 
 uint8_t leapyear(uint16_t y);
+uint8_t month_days(uint8_t mo, uint8_t y);
 void clock_init(void);
+void clock_check(void);
 void initbuttons(void);
+void button_calibrate(void);
 void tick(void);
 void setsnooze(void);
 void initanim(void);
@@ -188,15 +412,15 @@ void initdisplay(uint8_t inverted);
 void step(void);
 void setscore(void);
 void draw(uint8_t inverted);
+void drawbigdigit(uint8_t x, uint8_t y, uint8_t d, uint8_t scale, uint8_t inverted);
+void drawbigtime(uint8_t inverted);
+void drawrtcstatus(uint8_t inverted);
 
-void set_alarm(void);
-void set_time(void);
-void set_region(void);
-void set_date(void);
-void set_backlight(void);
+extern const menu_t config_menu;
 #ifdef AUTODIM
+extern const menu_t autodim_menu;
 void autoDim(uint8_t hour, uint8_t minute);
-void setBacklightAutoDim(void);
+void autoDimNow(void);
 #ifdef AUTODIM_EEPROM
 void init_autodim_eeprom(void);
 void update_autodst_eeprom(uint8_t value);
@@ -209,12 +433,13 @@ void autodst(uint8_t* rule);
 void init_autodst_eeprom(void);
 #endif //#ifdef AUTODST
 void print_timehour(uint8_t h, uint8_t inverted);
-void print_alarmhour(uint8_t h, uint8_t inverted);
-void display_menu(void);
+void print_ampm(uint8_t h, uint8_t inverted);
 void drawArrow(uint8_t x, uint8_t y, uint8_t l);
 void setalarmstate(void);
 void beep(uint16_t freq, uint8_t duration);
 void printnumber(uint8_t n, uint8_t inverted);
+void printbcd(uint8_t n, uint8_t inverted);
+void printnumber3(uint8_t n, uint8_t inverted);
 
 void init_crand(void);
 uint8_t dotw(uint8_t mon, uint8_t day, uint8_t yr);
@@ -222,6 +447,35 @@ uint8_t dotw(uint8_t mon, uint8_t day, uint8_t yr);
 uint8_t i2bcd(uint8_t x);
 
 uint8_t readi2ctime(void);
+void get_time_snapshot(datetime_t *t);
+void rtc_set(datetime_t *t);
+uint8_t rtc_read_start(void);
+void rtc_init(void);
+void rtc_poll(void);
+void rtc_ms(void);
+void task_rtc(void);
+
+void sched_tick(void);
+void sched_ready(uint8_t task);
+void sched_run(void);
+void sched_report(void);
+
+void timer_tick(void);
+uint32_t uptime_ms(void);
+void timer_start(uint8_t t, uint32_t ms, uint16_t period, void (*run)(void));
+void timer_stop(uint8_t t);
+uint8_t timer_pending(uint8_t t);
+void timer_run(void);
+
+void menu_run(const menu_t *page);
+void menu_clock(void);
+void menu_ee_update(uint8_t addr, uint8_t v);
+uint8_t bcd_add_wrap(uint8_t x, uint8_t n, uint8_t first, uint8_t last);
+
+uint8_t event_put(uint8_t type, uint8_t data);
+uint8_t event_get(event_t *e);
+uint8_t event_waiting(void);
+void event_poll(void);
 
 void writei2ctime(uint8_t sec, uint8_t min, uint8_t hr, uint8_t day,
 		  uint8_t date, uint8_t mon, uint8_t yr);
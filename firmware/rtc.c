@@ -0,0 +1,372 @@
+/* ***************************************************************************
+// rtc.c - keeps the time with the DS1307 real time clock
+// This code is distributed under the GNU Public License
+//		which can be found at http://www.gnu.org/licenses/gpl.txt
+//
+// clock_poll() calls rtc_poll() 6 times a second, which reads the time over i2c
+// in the background (or leaves it to the RTC's square wave, see RTC_SQW).
+// The i2c functions give up on a stuck bus and clear it.  If the RTC does
+// not answer RTC_RETRIES times in a row, rtc_lost is set and timer0 keeps
+// the time (rtc_ms()) until the RTC answers again.
+**************************************************************************** */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "util.h"
+#include "ratt.h"
+#include "i2c.h"
+
+// errors in a row before we keep the time ourselves
+#define RTC_RETRIES 3
+// 6Hz ticks a background read may take before we give up on it
+#define RTC_BUSY_TICKS 2
+// 6Hz ticks between asking a lost RTC whether it is back
+#define RTC_LOST_TICKS 60
+// 100us polls rtc_claim() waits for a background read, a whole one
+// takes about 1ms at 100kHz
+#define RTC_CLAIM_POLLS 50
+// timer0 interrupts per second, see main(): 8MHz / 64 / (OCR0A+1)
+#define RTC_TIMER0_HZ (F_CPU / 64 / 126)
+
+// the time, and a count that goes odd while it is changed and even again
+// after: a reader that saw the same even count before and after its copy
+// has one that wasn't changed half way (see get_time_snapshot())
+volatile datetime_t rtc_time;
+volatile uint8_t rtc_seq = 0;
+
+// the RTC doesn't answer, timer0 keeps the time
+volatile uint8_t rtc_lost = 0;
+// failed transfers in a row
+volatile uint8_t rtc_errors = 0;
+// 6Hz ticks the background read has been going on for
+uint8_t rtc_busy = 0;
+// 6Hz ticks until we ask a lost RTC again
+uint8_t rtc_retry = 0;
+// ms into the second while timer0 keeps the time
+uint16_t rtc_ms_count = 0;
+// TASK_RTC found a read going on, rtc_read_done() runs it again
+volatile uint8_t rtc_reread = 0;
+
+#ifdef RTC_SQW
+// 6Hz ticks left before we decide the square wave has stopped,
+// while this is 0 the time is read over i2c
+volatile uint8_t sqw_alive = 0;
+#endif
+
+// wait for a transfer the timers started, then keep them from starting
+// another one: returns with interrupts off.  A transfer that hangs is
+// given up on (rtc_poll() can't, it runs from the same main loop).
+static void rtc_claim(void) {
+  uint8_t polls;
+
+  for (polls = 0; polls < RTC_CLAIM_POLLS; polls++) {
+    cli();
+    if (i2cGetState() == I2C_IDLE)
+      return;
+    sei();
+    _delay_us(100);
+  }
+  i2cMasterAbort();
+  cli();
+}
+
+// keep count of how the RTC answers, with interrupts off
+static void rtc_result(uint8_t r) {
+  if (r == I2C_OK) {
+    rtc_errors = 0;
+    rtc_lost = 0;
+  } else if (rtc_errors < RTC_RETRIES) {
+    if (++rtc_errors == RTC_RETRIES) {
+      DEBUG(putstring_nl("RTC lost"));
+      rtc_lost = 1;
+    }
+  }
+}
+
+// a blocking transfer, tried again (on a cleared bus) if it fails
+static uint8_t rtc_transfer(uint8_t sendlength, uint8_t *senddata,
+			    uint8_t receivelength, uint8_t *receivedata) {
+  uint8_t r, tries;
+
+  for (tries = 0; tries < RTC_RETRIES; tries++) {
+    rtc_claim();
+    r = i2cMasterTransferNI(0xD0, sendlength, senddata, receivelength, receivedata);
+    rtc_result(r);
+    sei();
+    if (r == I2C_OK)
+      break;
+    DEBUG(putstring("RTC i2c error ")); DEBUG(uart_putw_dec(r)); DEBUG(putstring_nl(""));
+  }
+  return r;
+}
+
+// rtc_time is only changed from an interrupt or with interrupts off, so
+// there is never more than one writer
+static inline void rtc_write_begin(void) {
+  rtc_seq++;
+}
+
+static inline void rtc_write_end(void) {
+  rtc_seq++;
+}
+
+// the time from the RTC's first 7 registers, returns the clock halt bit
+// (they are BCD already, only the flags are masked off)
+static uint8_t rtc_decode(uint8_t *clockdata) {
+  uint8_t h;
+
+  if (clockdata[2] & _BV(6)) {
+    // "12 hr" mode, we never set it so it may as well be slow
+    h = bcd2i(clockdata[2] & 0x1F) % 12;
+    if (clockdata[2] & _BV(5))
+      h += 12;
+    h = i2bcd(h);
+  } else {
+    h = clockdata[2] & 0x3F;
+  }
+
+  if ((clockdata[0] & 0x7F) != rtc_time.s)
+    event_put(EVENT_TICK, clockdata[0] & 0x7F);
+  rtc_write_begin();
+  rtc_time.s = clockdata[0] & 0x7F;
+  rtc_time.m = clockdata[1] & 0x7F;
+  rtc_time.h = h;
+  rtc_time.d = clockdata[4] & 0x3F;
+  rtc_time.mo = clockdata[5] & 0x1F;
+  rtc_time.y = clockdata[6];
+  rtc_write_end();
+
+  return clockdata[0] & 0x80;
+}
+
+// called from the TWI interrupt once rtc_read_start() has the registers
+static void rtc_read_done(uint8_t status, uint8_t length, uint8_t *clockdata) {
+  // on an error the time stays as it is until the next read
+  if ((status == I2C_OK) && (length != 7))
+    status = I2C_ERROR_BUS;
+  if (status == I2C_OK)
+    rtc_decode(clockdata);
+  rtc_result(status);
+  if (rtc_reread) {
+    rtc_reread = 0;
+    sched_ready(TASK_RTC);
+  }
+}
+
+// start reading the time in the background, the time variables change
+// when it is in. Returns I2C_ERROR_BUSY if a transfer is going on.
+uint8_t rtc_read_start(void) {
+  uint8_t regaddr = 0;
+
+  return i2cMasterTransfer(0xD0, 1, &regaddr, 7, rtc_read_done);
+}
+
+// read the time and wait for it, returns the clock halt bit
+// (the time is left alone if the RTC doesn't answer)
+uint8_t readi2ctime(void) {
+  uint8_t regaddr = 0;
+  uint8_t clockdata[8];
+  uint8_t halted;
+
+  if (rtc_transfer(1, &regaddr, 7, &clockdata[0]) != I2C_OK)
+    return 0;
+  cli();
+  halted = rtc_decode(clockdata);
+  sei();
+  return halted;
+}
+
+// a copy of the time all from the same moment, without turning interrupts
+// off.  The count is never odd in an interrupt (the only writer outside of
+// one has them off), so it doesn't spin there.
+void get_time_snapshot(datetime_t *t) {
+  uint8_t seq;
+
+  do {
+    seq = rtc_seq;
+    *t = rtc_time;
+  } while ((seq & 1) || (seq != rtc_seq));
+}
+
+// set the time (from the menus), the RTC first so that a read that was
+// already going on can't put the old time back afterwards
+void rtc_set(datetime_t *t) {
+  writei2ctime(t->s, t->m, t->h, 0, t->d, t->mo, t->y);
+
+  cli();
+  rtc_write_begin();
+  rtc_time = *t;
+  rtc_write_end();
+  sei();
+}
+
+// all in BCD
+void writei2ctime(uint8_t sec, uint8_t min, uint8_t hr, uint8_t day,
+		  uint8_t date, uint8_t mon, uint8_t yr) {
+  uint8_t clockdata[8] = {0,0,0,0,0,0,0,0};
+
+  clockdata[0] = 0; // address
+  clockdata[1] = sec;  // s
+  clockdata[2] = min;  // m
+  clockdata[3] = hr; // h
+  clockdata[4] = day;  // day
+  clockdata[5] = date;  // date
+  clockdata[6] = mon;  // month
+  clockdata[7] = yr; // year
+
+  // if this fails timer0 keeps the time we were given
+  rtc_transfer(8, &clockdata[0], 0, 0);
+}
+
+void rtc_init(void) {
+  i2cInit();
+
+  if (readi2ctime()) {
+    DEBUGP("uh oh, RTC was off, lets reset it!");
+    writei2ctime(0, 0, 0x12, 0, 1, 1, 9); // noon 1/1/2009
+   }
+
+  readi2ctime();
+
+#ifdef RTC_SQW
+  // 1Hz square wave out (control register: SQWE, RS1 = RS0 = 0)
+  uint8_t sqwdata[2] = {0x07, 0x10};
+  rtc_transfer(2, &sqwdata[0], 0, 0);
+
+  SQW_DDR &= ~_BV(SQW);
+  SQW_PORT |= _BV(SQW);
+  SQW_PCMSK |= _BV(SQW);
+  PCICR |= _BV(SQW_PCIE);
+#endif
+}
+
+// clock_poll() calls this 6 times a second, from the main loop
+void rtc_poll(void) {
+  if (i2cGetState() != I2C_IDLE) {
+    // the TWI interrupt should long be done with it
+    if (++rtc_busy >= RTC_BUSY_TICKS) {
+      rtc_busy = 0;
+      i2cMasterAbort();
+    }
+    return;
+  }
+  rtc_busy = 0;
+
+#ifdef RTC_SQW
+  // SQW_vect keeps the time, unless the square wave stopped
+  cli();
+  if (sqw_alive) {
+    sqw_alive--;
+    sei();
+    return;
+  }
+  sei();
+#endif
+
+  if (rtc_lost) {
+    // timer0 keeps the time, ask the RTC now and then
+    if (rtc_retry) {
+      rtc_retry--;
+      return;
+    }
+    rtc_retry = RTC_LOST_TICKS;
+  }
+  rtc_read_start();
+}
+
+// timer0 calls this every ms, it keeps the time while the RTC is lost
+void rtc_ms(void) {
+  if (! rtc_lost) {
+    rtc_ms_count = 0;
+    return;
+  }
+#ifdef RTC_SQW
+  if (sqw_alive)
+    return;
+#endif
+  if (++rtc_ms_count >= RTC_TIMER0_HZ) {
+    rtc_ms_count = 0;
+    tick();
+  }
+}
+
+#ifdef RTC_SQW
+// the DS1307 counts its seconds on the falling edge of the square wave
+SIGNAL(SQW_vect) {
+  if (SQW_PIN & _BV(SQW))
+    return;
+
+  if (! sqw_alive) {
+    // the time we polled may or may not have this second in it yet,
+    // so start counting from a fresh read
+    sqw_alive = SQW_TIMEOUT;
+    sched_ready(TASK_RTC);
+    return;
+  }
+  sqw_alive = SQW_TIMEOUT;
+
+  tick();
+  // any drift is picked up from the RTC once a minute
+  if (rtc_time.s == 0)
+    sched_ready(TASK_RTC);
+}
+#endif
+
+void task_rtc(void) {
+  // busy with a read that may be from before the resync was asked for:
+  // go again when it is in, not round and round until then.  With
+  // interrupts off, so it can't finish in between
+  cli();
+  if (rtc_read_start() == I2C_ERROR_BUSY)
+    rtc_reread = 1;
+  sei();
+}
+
+uint8_t leapyear(uint16_t y) {
+  return ( (!(y % 4) && (y % 100)) || !(y % 400));
+}
+
+// how many days month mo of 20y has, all in BCD
+uint8_t month_days(uint8_t mo, uint8_t y) {
+  if (mo == 2)
+    return leapyear(2000 + bcd2i(y)) ? 0x29 : 0x28;
+  if ((mo == 4) || (mo == 6) || (mo == 9) || (mo == 0x11))
+    return 0x30;
+  return 0x31;
+}
+
+// one second on, date and all (in BCD), from an interrupt
+void tick(void) {
+  datetime_t t = rtc_time;
+
+  t.s = bcd_inc(t.s);
+  if (t.s == 0x60) {
+    t.s = 0;
+    t.m = bcd_inc(t.m);
+  }
+  if (t.m == 0x60) {
+    t.m = 0;
+    t.h = bcd_inc(t.h);
+  }
+  if (t.h == 0x24) {
+    t.h = 0;
+
+    t.d = bcd_inc_wrap(t.d, 1, month_days(t.mo, t.y));
+    if (t.d == 1) {
+      t.mo = bcd_inc_wrap(t.mo, 1, 0x12);
+      if (t.mo == 1)
+	t.y = bcd_inc_wrap(t.y, 0, 0x99);
+    }
+  }
+
+  rtc_write_begin();
+  rtc_time = t;
+  rtc_write_end();
+  event_put(EVENT_TICK, t.s);
+}
+
+// binary to BCD, divides: not for anything that runs often
+inline uint8_t i2bcd(uint8_t x) {
+  return ((x/10)<<4) | (x%10);
+}
@@ -0,0 +1,139 @@
+/* ***************************************************************************
+// sched.c - runs the main loop's tasks when they are due
+// This code is distributed under the GNU Public License
+//		which can be found at http://www.gnu.org/licenses/gpl.txt
+//
+// Cooperative: a task runs to completion, then the ready task with the
+// nearest deadline is next.  The task table is in ratt.c, the task
+// numbers in ratt.h.  With nothing ready, the cpu sleeps until the next
+// interrupt.
+**************************************************************************** */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include "util.h"
+#include "ratt.h"
+
+extern const task_t tasks[SCHED_TASKS];
+
+// one bit per task, everything runs once at startup
+volatile uint8_t task_ready = (1 << SCHED_TASKS) - 1;
+// ms until a periodic task is due again
+volatile uint16_t task_due[SCHED_TASKS];
+// ms a ready task has left before it is late
+volatile uint16_t task_deadline[SCHED_TASKS];
+
+// how often each task ran, the longest it took (in us)
+// and how many times it started after its deadline
+uint16_t task_runs[SCHED_TASKS];
+uint32_t task_worst[SCHED_TASKS];
+uint16_t task_late[SCHED_TASKS];
+
+// ms since startup, see timer.c
+extern volatile uint32_t uptime;
+
+// with interrupts off
+static void make_ready(uint8_t t) {
+  if (! (task_ready & _BV(t))) {
+    task_ready |= _BV(t);
+    task_deadline[t] = pgm_read_word(&tasks[t].deadline);
+  }
+}
+
+// called from the 1ms timer0 interrupt
+void sched_tick(void) {
+  uint8_t t;
+  uint16_t period;
+
+  for (t = 0; t < SCHED_TASKS; t++) {
+    if (task_ready & _BV(t)) {
+      if (task_deadline[t])
+	task_deadline[t]--;
+    }
+    period = pgm_read_word(&tasks[t].period);
+    if (period && (task_due[t] == 0 || --task_due[t] == 0)) {
+      task_due[t] = period;
+      make_ready(t);
+    }
+  }
+}
+
+// a task's inputs changed, run it soon (from anywhere, interrupts too)
+void sched_ready(uint8_t task) {
+  uint8_t sreg = SREG;
+  cli();
+  make_ready(task);
+  SREG = sreg;
+}
+
+// time since the uptime's low 16 bits were 0, in timer0 counts (8us at 8MHz)
+static uint32_t sched_now(void) {
+  uint16_t ms;
+  uint8_t cnt;
+
+  cli();
+  ms = uptime;
+  cnt = TCNT0;
+  // the compare match may have happened while we looked
+  if (TIFR0 & _BV(OCF0A)) {
+    ms++;
+    cnt = TCNT0;
+  }
+  sei();
+  return (uint32_t)ms * (OCR0A+1) + cnt;
+}
+
+// run the most urgent ready task, or sleep until an interrupt if there is none
+void sched_run(void) {
+  uint8_t t, next = SCHED_TASKS;
+  void (*run)(void);
+  uint32_t start, took;
+
+  cli();
+  for (t = 0; t < SCHED_TASKS; t++) {
+    if ((task_ready & _BV(t)) &&
+	((next == SCHED_TASKS) || (task_deadline[t] < task_deadline[next])))
+      next = t;
+  }
+  if (next == SCHED_TASKS) {
+    // sei right before sleep_cpu is safe, the sleep always executes
+    // before a pending interrupt is taken, so no wakeup is missed
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+    return;
+  }
+  task_ready &= ~_BV(next);
+  if (task_deadline[next] == 0)
+    task_late[next]++;
+  sei();
+
+  run = (void (*)(void))pgm_read_word(&tasks[next].run);
+  start = sched_now();
+  run();
+  took = sched_now();
+  // the ms wrapped (every 65 s, only the menus take that long)
+  if (took < start)
+    took += 65536UL * (OCR0A+1);
+  took = (took - start) * (1000000UL / (F_CPU / 64));
+  task_runs[next]++;
+  if (took > task_worst[next])
+    task_worst[next] = took;
+}
+
+// print what every task has been up to on the uart
+void sched_report(void) {
+  uint8_t t;
+
+  for (t = 0; t < SCHED_TASKS; t++) {
+    putstring("task "); uart_putw_dec(t);
+    putstring(" runs "); uart_putw_dec(task_runs[t]);
+    putstring(" worst us "); uart_putdw_dec(task_worst[t]);
+    putstring(" late "); uart_putw_dec(task_late[t]);
+    putstring_nl("");
+  }
+}
@@ -0,0 +1,153 @@
+/* ***************************************************************************
+// timer.c - the ms uptime and one-shot/periodic timers for the main loop
+// This code is distributed under the GNU Public License
+//		which can be found at http://www.gnu.org/licenses/gpl.txt
+//
+// The timers hang off a wheel of TIMER_SLOTS lists, picked by the low
+// bits of the uptime they are due at and sorted within the list.  The
+// 1ms interrupt only looks at the head of this ms's list (timer_tick()),
+// however many timers are running, and makes TASK_TIMER ready when it is
+// due.  timer_run() then calls the callbacks from the main loop.  The
+// timer numbers are in ratt.h.
+**************************************************************************** */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "util.h"
+#include "ratt.h"
+
+// a power of 2
+#define TIMER_SLOTS 16
+#define TIMER_NONE 0xFF
+
+typedef struct {
+  uint32_t due;		// uptime it runs out at
+  uint16_t period;	// ms until it runs out again, 0 for a one-shot
+  void (*run)(void);	// called from the main loop, may be 0
+  uint8_t next;		// the next timer in the same slot
+} swtimer_t;
+
+// ms since startup, counted by the 1ms timer0 interrupt
+volatile uint32_t uptime = 0;
+
+static swtimer_t timers[TIMERS];
+// first timer of each slot
+static volatile uint8_t wheel[TIMER_SLOTS] = {
+  TIMER_NONE, TIMER_NONE, TIMER_NONE, TIMER_NONE,
+  TIMER_NONE, TIMER_NONE, TIMER_NONE, TIMER_NONE,
+  TIMER_NONE, TIMER_NONE, TIMER_NONE, TIMER_NONE,
+  TIMER_NONE, TIMER_NONE, TIMER_NONE, TIMER_NONE,
+};
+// one bit per timer that is running
+static volatile uint8_t timer_armed = 0;
+// the uptime timer_run() has looked up to
+static uint32_t timer_last = 0;
+
+// called from the 1ms timer0 interrupt
+void timer_tick(void) {
+  uint8_t t;
+
+  uptime++;
+  t = wheel[(uint8_t)uptime & (TIMER_SLOTS-1)];
+  if ((t != TIMER_NONE) && (timers[t].due == uptime))
+    sched_ready(TASK_TIMER);
+}
+
+// the uptime in ms, all 4 bytes from the same moment
+uint32_t uptime_ms(void) {
+  uint32_t ms;
+  uint8_t sreg = SREG;
+
+  cli();
+  ms = uptime;
+  SREG = sreg;
+  return ms;
+}
+
+// with interrupts off
+static void timer_unlink(uint8_t t) {
+  volatile uint8_t *p = &wheel[(uint8_t)timers[t].due & (TIMER_SLOTS-1)];
+
+  while (*p != t)
+    p = &timers[*p].next;
+  *p = timers[t].next;
+  timer_armed &= ~_BV(t);
+}
+
+// with interrupts off, the earliest first
+static void timer_link(uint8_t t) {
+  volatile uint8_t *p = &wheel[(uint8_t)timers[t].due & (TIMER_SLOTS-1)];
+
+  while ((*p != TIMER_NONE) && ((int32_t)(timers[*p].due - timers[t].due) <= 0))
+    p = &timers[*p].next;
+  timers[t].next = *p;
+  *p = t;
+  timer_armed |= _BV(t);
+}
+
+// run out in ms (at least 1), then every period ms if that isn't 0.
+// Starting a timer that is running starts it over. From anywhere.
+void timer_start(uint8_t t, uint32_t ms, uint16_t period, void (*run)(void)) {
+  uint8_t sreg = SREG;
+
+  if (ms == 0)
+    ms = 1;
+  cli();
+  if (timer_armed & _BV(t))
+    timer_unlink(t);
+  timers[t].due = uptime + ms;
+  timers[t].period = period;
+  timers[t].run = run;
+  timer_link(t);
+  SREG = sreg;
+}
+
+// from anywhere
+void timer_stop(uint8_t t) {
+  uint8_t sreg = SREG;
+
+  cli();
+  if (timer_armed & _BV(t))
+    timer_unlink(t);
+  SREG = sreg;
+}
+
+// still running?
+uint8_t timer_pending(uint8_t t) {
+  return timer_armed & _BV(t);
+}
+
+// call the callbacks of the timers that ran out (TASK_TIMER, and the
+// menus while they keep the main loop waiting)
+void timer_run(void) {
+  uint32_t now = uptime_ms();
+  uint8_t n, t;
+  void (*run)(void);
+
+  // every slot since last time, once round the wheel at most
+  n = ((now - timer_last) < TIMER_SLOTS) ? (now - timer_last) : TIMER_SLOTS;
+  while (n--) {
+    timer_last++;
+    while (1) {
+      cli();
+      t = wheel[(uint8_t)timer_last & (TIMER_SLOTS-1)];
+      if ((t == TIMER_NONE) || ((int32_t)(timers[t].due - now) > 0)) {
+	sei();
+	break;
+      }
+      timer_unlink(t);
+      if (timers[t].period) {
+	// keep in step, unless we are so late it would run out again at once
+	timers[t].due += timers[t].period;
+	if ((int32_t)(timers[t].due - now) <= 0)
+	  timers[t].due = now + timers[t].period;
+	timer_link(t);
+      }
+      run = timers[t].run;
+      sei();
+      if (run)
+	run();
+    }
+  }
+  timer_last = now;
+}